@@ -0,0 +1,44 @@
+#!/usr/bin/env python
+
+# Republishes a compact joint state stream (CHANNEL_COMPACT + CHANNEL_SCHEMA)
+# as full bot_core.joint_state_t messages on CHANNEL, for tools that need
+# joint names.
+#
+# usage: expand-compact-joint-state.py [CHANNEL]    (default CORE_ROBOT_STATE)
+
+import lcm
+import bot_core as lcmbotcore
+import valkyrie_translator as lcmvaltrans
+import sys
+
+channel = sys.argv[1] if len(sys.argv) > 1 else "CORE_ROBOT_STATE"
+
+myLCM = lcm.LCM()
+schemas = {}
+
+def handle_schema(channel_name, data):
+    schema = lcmvaltrans.joint_schema_t.decode(data)
+    if schema.schema_hash not in schemas:
+        print "Got schema " + hex(schema.schema_hash & 0xffffffffffffffff) + " with " + str(schema.num_joints) + " joints"
+    schemas[schema.schema_hash] = schema
+
+def handle_state(channel_name, data):
+    compact = lcmvaltrans.joint_state_compact_t.decode(data)
+    schema = schemas.get(compact.schema_hash)
+    if schema is None or schema.num_joints != compact.num_joints:
+        return
+
+    msg = lcmbotcore.joint_state_t()
+    msg.utime = compact.utime
+    msg.num_joints = compact.num_joints
+    msg.joint_name = schema.joint_name
+    msg.joint_position = compact.joint_position
+    msg.joint_velocity = compact.joint_velocity
+    msg.joint_effort = compact.joint_effort
+    myLCM.publish(channel, msg.encode())
+
+myLCM.subscribe(channel + "_SCHEMA", handle_schema)
+myLCM.subscribe(channel + "_COMPACT", handle_state)
+
+while True:
+    myLCM.handle()
@@ -0,0 +1,32 @@
+#!/usr/bin/env python
+
+# Sends a whole neck motion as one joint_trajectory_t, for a
+# NeckPositionGoalController with accept_trajectories set.
+#
+# usage: send-neck-trajectory.py [--append] T LOWER_PITCH YAW UPPER_PITCH [T LOWER_PITCH YAW UPPER_PITCH ...]
+#   T is the time in seconds from the start of the motion at which the
+#   waypoint is reached.
+
+import lcm
+import valkyrie_translator as lcmvaltrans
+import sys
+
+args = sys.argv[1:]
+append = len(args) > 0 and args[0] == "--append"
+if append:
+    args = args[1:]
+if len(args) == 0 or len(args) % 4 != 0:
+    print "usage: send-neck-trajectory.py [--append] T LOWER_PITCH YAW UPPER_PITCH [...]"
+    sys.exit(1)
+
+myLCM = lcm.LCM()
+
+msg = lcmvaltrans.joint_trajectory_t()
+msg.append = append
+msg.joint_name = ["lowerNeckPitch", "neckYaw", "upperNeckPitch"]
+msg.num_joints = len(msg.joint_name)
+msg.time_from_start = [float(t) for t in args[0::4]]
+msg.joint_position = [[float(q) for q in args[i + 1:i + 4]] for i in range(0, len(args), 4)]
+msg.num_points = len(msg.time_from_start)
+
+myLCM.publish("DESIRED_NECK_ANGLES_TRAJECTORY", msg.encode())
@@ -0,0 +1,121 @@
+#ifndef COMMANDLATENCY_HPP
+#define COMMANDLATENCY_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <lcm/lcm-cpp.hpp>
+#include "lcmtypes/valkyrie_translator/command_latency_t.hpp"
+
+#include "ControllerTiming.hpp"
+#include "RealtimeLCMPublisher.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Tracks how old incoming commands are by the time they reach the joints.
+
+      Each command carries the sender's utime, the LCM receive time and a
+      sequence number assigned by the receiving handler. Once update() has
+      written a new command to the joint handles, commandApplied() records
+      transport (sender -> receive), queue (receive -> joints) and total
+      (sender -> joints) ages into histograms and sends a command_latency_t
+      echoing the command's utime. Histograms restart about once per second.
+
+      Receive and apply times are wall clock (LCM stamps recv_utime with
+      gettimeofday), so queue ages are exact while transport and total ages
+      are only meaningful when the sender's clock is synchronised with ours. */
+   class CommandLatencyTracker
+   {
+   public:
+        CommandLatencyTracker(const std::shared_ptr<lcm::LCM>& lcm, const std::string& channel)
+          : publisher_(lcm, channel), last_sequence_(0), num_commands_(0), num_superseded_(0)
+        {
+          command_latency_t& msg = publisher_.msg_;
+          msg.utime = 0;
+          msg.source_utime = 0;
+          msg.receive_utime = 0;
+          msg.apply_utime = 0;
+          msg.num_commands = 0;
+          msg.num_superseded = 0;
+          window_start_ = std::chrono::steady_clock::now();
+        }
+
+        static int64_t wallUtime()
+        {
+          return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        // Sequence numbers are only comparable within one command source; call
+        // this when commands start coming from another one.
+        void sourceChanged()
+        {
+          last_sequence_ = 0;
+        }
+
+        void commandApplied(int64_t utime, int64_t source_utime, int64_t receive_utime, uint32_t sequence)
+        {
+          int64_t apply_utime = wallUtime();
+          transport_.add(toNanoseconds(receive_utime - source_utime));
+          queue_.add(toNanoseconds(apply_utime - receive_utime));
+          total_.add(toNanoseconds(apply_utime - source_utime));
+          num_commands_++;
+          if (last_sequence_ != 0 && sequence > last_sequence_ + 1)
+            num_superseded_ += sequence - last_sequence_ - 1;
+          last_sequence_ = sequence;
+
+          if (publisher_.trylock())
+          {
+            command_latency_t& msg = publisher_.msg_;
+            msg.utime = utime;
+            msg.source_utime = source_utime;
+            msg.receive_utime = receive_utime;
+            msg.apply_utime = apply_utime;
+            msg.num_commands = static_cast<int32_t>(num_commands_);
+            msg.num_superseded = static_cast<int32_t>(num_superseded_);
+            fillStatistics(transport_, msg.transport_p50_us, msg.transport_p99_us, msg.transport_max_us);
+            fillStatistics(queue_, msg.queue_p50_us, msg.queue_p99_us, msg.queue_max_us);
+            fillStatistics(total_, msg.total_p50_us, msg.total_p99_us, msg.total_max_us);
+            publisher_.unlockAndPublish();
+          }
+
+          std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+          if (now - window_start_ >= std::chrono::seconds(1))
+          {
+            transport_.reset();
+            queue_.reset();
+            total_.reset();
+            num_commands_ = 0;
+            num_superseded_ = 0;
+            window_start_ = now;
+          }
+        }
+
+   private:
+        // Ages below zero can only come from clock offsets; count them as zero.
+        static uint64_t toNanoseconds(int64_t microseconds)
+        {
+          return microseconds > 0 ? static_cast<uint64_t>(microseconds) * 1000 : 0;
+        }
+
+        static void fillStatistics(const LatencyHistogram& histogram, float& p50, float& p99, float& max)
+        {
+          p50 = histogram.percentile(0.5) * 1e-3f;
+          p99 = histogram.percentile(0.99) * 1e-3f;
+          max = histogram.max() * 1e-3f;
+        }
+
+        RealtimeLCMPublisher<command_latency_t> publisher_;
+        LatencyHistogram transport_;
+        LatencyHistogram queue_;
+        LatencyHistogram total_;
+        uint32_t last_sequence_;
+        uint64_t num_commands_;
+        uint64_t num_superseded_;
+        std::chrono::steady_clock::time_point window_start_;
+   };
+}
+#endif
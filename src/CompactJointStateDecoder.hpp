@@ -0,0 +1,50 @@
+#ifndef COMPACTJOINTSTATEDECODER_HPP
+#define COMPACTJOINTSTATEDECODER_HPP
+
+#include <cstdint>
+#include <map>
+
+#include "lcmtypes/bot_core/joint_state_t.hpp"
+#include "lcmtypes/valkyrie_translator/joint_schema_t.hpp"
+#include "lcmtypes/valkyrie_translator/joint_state_compact_t.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Consumer side of the compact joint state stream: remembers the schemas
+      seen on <channel>_SCHEMA and rebuilds full joint_state_t messages from
+      <channel>_COMPACT for code that expects names. */
+   class CompactJointStateDecoder
+   {
+   public:
+        void handleSchema(const joint_schema_t& schema)
+        {
+          schemas_[schema.schema_hash] = schema;
+        }
+
+        bool knowsSchema(int64_t schema_hash) const
+        {
+          return schemas_.find(schema_hash) != schemas_.end();
+        }
+
+        // False until the matching schema has been seen.
+        bool expand(const joint_state_compact_t& compact, bot_core::joint_state_t& full) const
+        {
+          auto schema = schemas_.find(compact.schema_hash);
+          if (schema == schemas_.end() || schema->second.num_joints != compact.num_joints)
+            return false;
+
+          full.utime = compact.utime;
+          full.num_joints = compact.num_joints;
+          full.joint_name = schema->second.joint_name;
+          full.joint_position = compact.joint_position;
+          full.joint_velocity = compact.joint_velocity;
+          full.joint_effort = compact.joint_effort;
+          return true;
+        }
+
+   private:
+        std::map<int64_t, joint_schema_t> schemas_;
+   };
+}
+#endif
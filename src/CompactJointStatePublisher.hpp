@@ -0,0 +1,58 @@
+#ifndef COMPACTJOINTSTATEPUBLISHER_HPP
+#define COMPACTJOINTSTATEPUBLISHER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <lcm/lcm-cpp.hpp>
+#include "lcmtypes/valkyrie_translator/joint_state_compact_t.hpp"
+
+#include "JointSchemaAnnouncer.hpp"
+#include "RealtimeLCMPublisher.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Publishes joint state without joint names: a joint_state_compact_t on
+      channel + "_COMPACT" every time, and the joint_schema_t that names its
+      entries on channel + "_SCHEMA" on the first publish and about once a
+      second afterwards. Used like RealtimeLCMPublisher:
+
+        if (pub->trylock()) {
+          pub->msg().joint_position[i] = ...;
+          pub->unlockAndPublish(utime);
+        } */
+   class CompactJointStatePublisher
+   {
+   public:
+        CompactJointStatePublisher(const std::shared_ptr<lcm::LCM>& lcm, const std::string& channel,
+                                   const std::vector<std::string>& joint_names)
+          : state_pub_(lcm, channel + "_COMPACT"), schema_(lcm, channel + "_SCHEMA", joint_names)
+        {
+          joint_state_compact_t& state = state_pub_.msg_;
+          state.utime = 0;
+          state.schema_hash = schema_.hash();
+          state.num_joints = static_cast<int16_t>(joint_names.size());
+          state.joint_position.assign(joint_names.size(), 0.0f);
+          state.joint_velocity.assign(joint_names.size(), 0.0f);
+          state.joint_effort.assign(joint_names.size(), 0.0f);
+        }
+
+        bool trylock() { return state_pub_.trylock(); }
+
+        joint_state_compact_t& msg() { return state_pub_.msg_; }
+
+        void unlockAndPublish(int64_t utime)
+        {
+          state_pub_.msg_.utime = utime;
+          state_pub_.unlockAndPublish();
+          schema_.announce(utime);
+        }
+
+   private:
+        RealtimeLCMPublisher<joint_state_compact_t> state_pub_;
+        JointSchemaAnnouncer schema_;
+   };
+}
+#endif
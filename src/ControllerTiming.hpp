@@ -0,0 +1,234 @@
+#ifndef CONTROLLERTIMING_HPP
+#define CONTROLLERTIMING_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <ros/node_handle.h>
+#include <ros/time.h>
+
+#include <lcm/lcm-cpp.hpp>
+#include "lcmtypes/valkyrie_translator/controller_timing_t.hpp"
+
+#include "RealtimeLCMPublisher.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Histogram of durations with logarithmic buckets: four buckets per power
+      of two of nanoseconds, so every bucket is within 25% of its value. Fixed
+      size, no allocation, cheap enough to update from the control loop. */
+   class LatencyHistogram
+   {
+   public:
+        LatencyHistogram() { reset(); }
+
+        void reset()
+        {
+          memset(buckets_, 0, sizeof(buckets_));
+          count_ = 0;
+          min_ = UINT64_MAX;
+          max_ = 0;
+        }
+
+        void add(uint64_t ns)
+        {
+          buckets_[bucketIndex(ns)]++;
+          count_++;
+          min_ = std::min(min_, ns);
+          max_ = std::max(max_, ns);
+        }
+
+        // Upper edge of the bucket holding the p-th fraction of samples (0 <= p <= 1),
+        // never larger than the largest sample.
+        uint64_t percentile(double p) const
+        {
+          if (count_ == 0)
+            return 0;
+          uint64_t rank = static_cast<uint64_t>(p * (count_ - 1)) + 1;
+          uint64_t seen = 0;
+          for (int i = 0; i < NUM_BUCKETS; i++)
+          {
+            seen += buckets_[i];
+            if (seen >= rank)
+              return std::min(bucketUpperEdge(i), max_);
+          }
+          return max_;
+        }
+
+        uint64_t count() const { return count_; }
+        uint64_t min() const { return count_ ? min_ : 0; }
+        uint64_t max() const { return max_; }
+
+   private:
+        static const int SUB_BUCKET_BITS = 2;
+        static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static const int NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+        static int bucketIndex(uint64_t ns)
+        {
+          if (ns < SUB_BUCKETS)
+            return static_cast<int>(ns);
+          int exponent = 63 - __builtin_clzll(ns);
+          int sub_bucket = static_cast<int>((ns >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1));
+          return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+        }
+
+        static uint64_t bucketUpperEdge(int index)
+        {
+          if (index < SUB_BUCKETS)
+            return static_cast<uint64_t>(index);
+          int exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+          uint64_t sub_bucket = static_cast<uint64_t>(index % SUB_BUCKETS);
+          uint64_t width = 1ULL << (exponent - SUB_BUCKET_BITS);
+          return (1ULL << exponent) + (sub_bucket + 1) * width - 1;
+        }
+
+        uint64_t buckets_[NUM_BUCKETS];
+        uint64_t count_;
+        uint64_t min_;
+        uint64_t max_;
+   };
+
+   /* Per-cycle timing of a controller's update().
+
+      Call beginCycle() first thing in update(), mark() at the end of each
+      phase (the time since the previous mark is attributed to that phase)
+      and endCycle() last. Durations come from the monotonic clock and go into
+      LatencyHistograms; roughly once per second endCycle() summarises them
+      into a controller_timing_t (p50/p99/max per phase, overrun count and the
+      spacing of the time arguments) that is sent by a RealtimeLCMPublisher,
+      then starts a new window. */
+   class ControllerTiming
+   {
+   public:
+        enum phase
+        {
+          PHASE_INBOUND,   // picking up commands / goals
+          PHASE_CONTROL,   // evaluating the control law and safety limits
+          PHASE_COMMAND,   // writing commands to the joint handles
+          PHASE_PUBLISH,   // filling and handing over outbound messages
+          NUM_PHASES
+        };
+
+        // The timing a controller asked for with timing_stats_channel (and optionally
+        // timing_overrun_threshold, in seconds), or a null pointer if it did not ask.
+        static std::unique_ptr<ControllerTiming> fromParameters(const std::string& controller_name,
+                                                                const std::shared_ptr<lcm::LCM>& lcm,
+                                                                const ros::NodeHandle& controller_nh)
+        {
+          std::unique_ptr<ControllerTiming> timing;
+          std::string channel;
+          if (controller_nh.getParam("timing_stats_channel", channel) && !channel.empty())
+          {
+            double overrun_threshold = 0.002;
+            controller_nh.getParam("timing_overrun_threshold", overrun_threshold);
+            timing.reset(new ControllerTiming(controller_name, lcm, channel, overrun_threshold));
+          }
+          return timing;
+        }
+
+        ControllerTiming(const std::string& controller_name, const std::shared_ptr<lcm::LCM>& lcm,
+                         const std::string& channel, double overrun_threshold)
+          : publisher_(lcm, channel), overrun_threshold_ns_(static_cast<uint64_t>(overrun_threshold * 1e9)),
+            overruns_(0), have_last_time_(false)
+        {
+          static const char* phase_names[] = {"inbound", "control", "command", "publish", "cycle"};
+          controller_timing_t& msg = publisher_.msg_;
+          msg.utime = 0;
+          msg.controller = controller_name;
+          msg.num_cycles = 0;
+          msg.num_overruns = 0;
+          msg.overrun_threshold_us = static_cast<float>(overrun_threshold * 1e6);
+          msg.num_phases = NUM_PHASES + 1;
+          msg.phase_name.assign(phase_names, phase_names + NUM_PHASES + 1);
+          msg.p50_us.assign(NUM_PHASES + 1, 0.0f);
+          msg.p99_us.assign(NUM_PHASES + 1, 0.0f);
+          msg.max_us.assign(NUM_PHASES + 1, 0.0f);
+          msg.period_min_us = 0.0f;
+          msg.period_p50_us = 0.0f;
+          msg.period_p99_us = 0.0f;
+          msg.period_max_us = 0.0f;
+          window_start_ = std::chrono::steady_clock::now();
+        }
+
+        void beginCycle(const ros::Time& time)
+        {
+          cycle_start_ = std::chrono::steady_clock::now();
+          last_mark_ = cycle_start_;
+          if (have_last_time_ && time > last_time_)
+            period_.add((time - last_time_).toNSec());
+          last_time_ = time;
+          have_last_time_ = true;
+        }
+
+        void mark(phase p)
+        {
+          std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+          phases_[p].add(nanoseconds(now - last_mark_));
+          last_mark_ = now;
+        }
+
+        void endCycle()
+        {
+          std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+          uint64_t cycle_ns = nanoseconds(now - cycle_start_);
+          phases_[NUM_PHASES].add(cycle_ns);
+          if (cycle_ns > overrun_threshold_ns_)
+            overruns_++;
+
+          if (now - window_start_ >= std::chrono::seconds(1) && publisher_.trylock())
+          {
+            fillMessage();
+            publisher_.unlockAndPublish();
+            for (int i = 0; i <= NUM_PHASES; i++)
+              phases_[i].reset();
+            period_.reset();
+            overruns_ = 0;
+            window_start_ = now;
+          }
+        }
+
+   private:
+        static uint64_t nanoseconds(std::chrono::steady_clock::duration d)
+        {
+          return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+        }
+
+        void fillMessage()
+        {
+          controller_timing_t& msg = publisher_.msg_;
+          msg.utime = static_cast<int64_t>(last_time_.toNSec() / 1000);
+          msg.num_cycles = static_cast<int32_t>(phases_[NUM_PHASES].count());
+          msg.num_overruns = static_cast<int32_t>(overruns_);
+          for (int i = 0; i <= NUM_PHASES; i++)
+          {
+            msg.p50_us[i] = phases_[i].percentile(0.5) * 1e-3f;
+            msg.p99_us[i] = phases_[i].percentile(0.99) * 1e-3f;
+            msg.max_us[i] = phases_[i].max() * 1e-3f;
+          }
+          msg.period_min_us = period_.min() * 1e-3f;
+          msg.period_p50_us = period_.percentile(0.5) * 1e-3f;
+          msg.period_p99_us = period_.percentile(0.99) * 1e-3f;
+          msg.period_max_us = period_.max() * 1e-3f;
+        }
+
+        RealtimeLCMPublisher<controller_timing_t> publisher_;
+        uint64_t overrun_threshold_ns_;
+
+        LatencyHistogram phases_[NUM_PHASES + 1];  // last entry is the whole cycle
+        LatencyHistogram period_;
+        uint64_t overruns_;
+
+        std::chrono::steady_clock::time_point window_start_;
+        std::chrono::steady_clock::time_point cycle_start_;
+        std::chrono::steady_clock::time_point last_mark_;
+        ros::Time last_time_;
+        bool have_last_time_;
+   };
+}
+#endif
@@ -0,0 +1,313 @@
+#ifndef EFFORTCONTROLLAW_HPP
+#define EFFORTCONTROLLAW_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace valkyrie_translator
+{
+
+   // Keeps every array 32-byte aligned so the kernels can use aligned AVX loads.
+   template <class T>
+   struct AlignedAllocator
+   {
+        typedef T value_type;
+        static const size_t ALIGNMENT = 32;
+
+        AlignedAllocator() {}
+        template <class U> AlignedAllocator(const AlignedAllocator<U>&) {}
+        template <class U> struct rebind { typedef AlignedAllocator<U> other; };
+
+        T* allocate(size_t n)
+        {
+          void* p = nullptr;
+          if (posix_memalign(&p, ALIGNMENT, n * sizeof(T)) != 0)
+            throw std::bad_alloc();
+          return static_cast<T*>(p);
+        }
+
+        void deallocate(T* p, size_t) { free(p); }
+   };
+
+   template <class T, class U>
+   bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return true; }
+   template <class T, class U>
+   bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) { return false; }
+
+   typedef std::vector<double, AlignedAllocator<double> > aligned_vector;
+
+   /* Joint commands as structure-of-arrays, one entry per joint slot.
+      See drc_joint_command_t.lcm for an explanation of the gains. */
+   struct joint_command_arrays
+   {
+        aligned_vector position;
+        aligned_vector velocity;
+        aligned_vector effort;
+
+        aligned_vector k_q_p; // corresponds to kp_position in drcsim API
+        aligned_vector k_q_i; // corresponds to ki_position in drcsim API
+        aligned_vector k_qd_p; // corresponds to kp_velocity in drcsim API
+        aligned_vector k_f_p;
+        aligned_vector ff_qd; // maps to kd_position in drcsim API (there isnt an equivalent gain in the bdi api)
+        aligned_vector ff_qd_d;
+        aligned_vector ff_f_d;
+        aligned_vector ff_const;
+
+        // Resizes every array to n joints, all zero.
+        void assign(size_t n)
+        {
+          aligned_vector* fields[] = {&position, &velocity, &effort, &k_q_p, &k_q_i, &k_qd_p, &k_f_p,
+                                      &ff_qd, &ff_qd_d, &ff_f_d, &ff_const};
+          for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+            fields[i]->assign(n, 0.0);
+        }
+
+        size_t size() const { return position.size(); }
+   };
+
+   /* Scalar reference for the effort law of a single joint. */
+   inline double computeJointEffort(const joint_command_arrays& command, size_t i,
+                                    double q, double qd, double f, double dt)
+   {
+     return command.k_q_p[i] * ( command.position[i] - q ) +
+            command.k_q_i[i] * ( command.position[i] - q ) * dt +
+            command.k_qd_p[i] * ( command.velocity[i] - qd) +
+            command.k_f_p[i] * ( command.effort[i] - f) +
+            command.ff_qd[i] * ( qd ) +
+            command.ff_qd_d[i] * ( command.velocity[i] ) +
+            command.ff_f_d[i] * ( command.effort[i] ) +
+            command.ff_const[i];
+   }
+
+   /* Evaluates the effort law for joints [0, n) into effort_out.
+      q, qd and f hold the measured position, velocity and effort and must be
+      32-byte aligned (e.g. aligned_vector data). Uses AVX or SSE2 when the
+      build enables them, evaluating terms in the same order as
+      computeJointEffort. */
+   inline void computeEffort(const joint_command_arrays& command,
+                             const double* q, const double* qd, const double* f,
+                             double dt, double* effort_out, size_t n)
+   {
+     size_t i = 0;
+#if defined(__AVX__)
+     const __m256d vdt = _mm256_set1_pd(dt);
+     for (; i + 4 <= n; i += 4)
+     {
+       __m256d vq = _mm256_load_pd(q + i);
+       __m256d vqd = _mm256_load_pd(qd + i);
+       __m256d vf = _mm256_load_pd(f + i);
+       __m256d position = _mm256_load_pd(&command.position[i]);
+       __m256d velocity = _mm256_load_pd(&command.velocity[i]);
+       __m256d effort = _mm256_load_pd(&command.effort[i]);
+       __m256d position_err = _mm256_sub_pd(position, vq);
+
+       __m256d sum = _mm256_mul_pd(_mm256_load_pd(&command.k_q_p[i]), position_err);
+       sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_mul_pd(_mm256_load_pd(&command.k_q_i[i]), position_err), vdt));
+       sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_load_pd(&command.k_qd_p[i]), _mm256_sub_pd(velocity, vqd)));
+       sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_load_pd(&command.k_f_p[i]), _mm256_sub_pd(effort, vf)));
+       sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_load_pd(&command.ff_qd[i]), vqd));
+       sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_load_pd(&command.ff_qd_d[i]), velocity));
+       sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_load_pd(&command.ff_f_d[i]), effort));
+       sum = _mm256_add_pd(sum, _mm256_load_pd(&command.ff_const[i]));
+       _mm256_storeu_pd(effort_out + i, sum);
+     }
+#elif defined(__SSE2__)
+     const __m128d vdt = _mm_set1_pd(dt);
+     for (; i + 2 <= n; i += 2)
+     {
+       __m128d vq = _mm_load_pd(q + i);
+       __m128d vqd = _mm_load_pd(qd + i);
+       __m128d vf = _mm_load_pd(f + i);
+       __m128d position = _mm_load_pd(&command.position[i]);
+       __m128d velocity = _mm_load_pd(&command.velocity[i]);
+       __m128d effort = _mm_load_pd(&command.effort[i]);
+       __m128d position_err = _mm_sub_pd(position, vq);
+
+       __m128d sum = _mm_mul_pd(_mm_load_pd(&command.k_q_p[i]), position_err);
+       sum = _mm_add_pd(sum, _mm_mul_pd(_mm_mul_pd(_mm_load_pd(&command.k_q_i[i]), position_err), vdt));
+       sum = _mm_add_pd(sum, _mm_mul_pd(_mm_load_pd(&command.k_qd_p[i]), _mm_sub_pd(velocity, vqd)));
+       sum = _mm_add_pd(sum, _mm_mul_pd(_mm_load_pd(&command.k_f_p[i]), _mm_sub_pd(effort, vf)));
+       sum = _mm_add_pd(sum, _mm_mul_pd(_mm_load_pd(&command.ff_qd[i]), vqd));
+       sum = _mm_add_pd(sum, _mm_mul_pd(_mm_load_pd(&command.ff_qd_d[i]), velocity));
+       sum = _mm_add_pd(sum, _mm_mul_pd(_mm_load_pd(&command.ff_f_d[i]), effort));
+       sum = _mm_add_pd(sum, _mm_load_pd(&command.ff_const[i]));
+       _mm_storeu_pd(effort_out + i, sum);
+     }
+#endif
+     for (; i < n; i++)
+       effort_out[i] = computeJointEffort(command, i, q[i], qd[i], f[i], dt);
+   }
+   /* Safety limits that fired for a joint in applyEffortLimits(), as bits. */
+   enum effort_limit_event
+   {
+     EFFORT_CLAMPED = 1 << 0,             // |effort| above the joint's max_effort
+     EFFORT_SCALED_NEAR_LIMIT = 1 << 1,   // joint past its position limit, effort ramped down
+     EFFORT_NULLED_OUT_OF_RANGE = 1 << 2, // joint too far past its position limit, effort zeroed
+     EFFORT_RATE_LIMITED = 1 << 3,        // too far from the currently applied effort
+     EFFORT_HARD_CUT = 1 << 4             // above the absolute hard limit, or any input NaN, zeroed
+   };
+
+   /* Per-joint limits used by applyEffortLimits(), as structure-of-arrays. */
+   struct effort_limit_arrays
+   {
+        aligned_vector min_position;
+        aligned_vector max_position;
+        aligned_vector max_effort;
+   };
+
+   /* Bounds shared by all joints. */
+   struct effort_safety_parameters
+   {
+        double position_err_bound; // effort ramps to 0 over this distance past a position limit
+        double max_change;         // maximum difference to the currently applied effort
+        double hard_limit;         // efforts at or above this magnitude are replaced by 0
+   };
+
+   /* Scalar reference for a single joint of applyEffortLimits(). Written
+      without data-dependent branches; returns the effort_limit_event bits. */
+   inline uint8_t limitJointEffort(double effort, double q, double f,
+                                   double min_position, double max_position, double max_effort,
+                                   const effort_safety_parameters& params, double* effort_out)
+   {
+     // a NaN command or measurement cannot be limited meaningfully
+     bool invalid = effort != effort || q != q || f != f;
+
+     // bound the force within our max force limits
+     double clamped = std::min(std::max(effort, -max_effort), max_effort);
+
+     // and ramp down the force to 0 over position_err_bound past the joint limit
+     double err_beyond_bound = std::max(q - max_position, min_position - q);
+     bool nulled = err_beyond_bound >= params.position_err_bound;
+     bool scaled = !nulled && err_beyond_bound >= 0.0;
+     double scale = std::min(std::max((params.position_err_bound - err_beyond_bound) / params.position_err_bound, 0.0), 1.0);
+     double ramped = clamped * scale;
+
+     // bound the force to be within max_change of the currently applied force
+     bool rate_limited = std::fabs(ramped - f) >= params.max_change;
+     double slewed = std::min(std::max(ramped, f - params.max_change), f + params.max_change);
+
+     bool hard_cut = invalid || !(std::fabs(slewed) < params.hard_limit);
+     *effort_out = hard_cut ? 0.0 : slewed;
+
+     // a NaN input only reports the hard cut
+     bool valid = !invalid;
+     return static_cast<uint8_t>((valid && clamped != effort) * EFFORT_CLAMPED |
+                                 (valid && scaled) * EFFORT_SCALED_NEAR_LIMIT |
+                                 (valid && nulled) * EFFORT_NULLED_OUT_OF_RANGE |
+                                 (valid && rate_limited) * EFFORT_RATE_LIMITED |
+                                 hard_cut * EFFORT_HARD_CUT);
+   }
+
+   /* Applies all effort safety limits to joints [0, n) in one branch-free
+      pass: effort clamp, ramp-down past the position limits, slew bound
+      relative to the measured effort f, and the absolute hard cut. Writes
+      the final command to effort_out and the effort_limit_event bits of
+      each joint to events. effort_in, q and f must be 32-byte aligned. */
+   inline void applyEffortLimits(const effort_limit_arrays& limits, const effort_safety_parameters& params,
+                                 const double* effort_in, const double* q, const double* f,
+                                 double* effort_out, uint8_t* events, size_t n)
+   {
+     size_t i = 0;
+#if defined(__AVX__)
+     const __m256d zero = _mm256_setzero_pd();
+     const __m256d one = _mm256_set1_pd(1.0);
+     const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+     const __m256d bound = _mm256_set1_pd(params.position_err_bound);
+     const __m256d max_change = _mm256_set1_pd(params.max_change);
+     const __m256d hard_limit = _mm256_set1_pd(params.hard_limit);
+     for (; i + 4 <= n; i += 4)
+     {
+       __m256d effort = _mm256_load_pd(effort_in + i);
+       __m256d vq = _mm256_load_pd(q + i);
+       __m256d vf = _mm256_load_pd(f + i);
+       __m256d max_effort = _mm256_load_pd(&limits.max_effort[i]);
+
+       __m256d invalid = _mm256_or_pd(_mm256_cmp_pd(effort, effort, _CMP_UNORD_Q),
+                                      _mm256_cmp_pd(vq, vf, _CMP_UNORD_Q));
+       __m256d clamped = _mm256_min_pd(_mm256_max_pd(effort, _mm256_sub_pd(zero, max_effort)), max_effort);
+       __m256d clamped_mask = _mm256_andnot_pd(invalid, _mm256_cmp_pd(clamped, effort, _CMP_NEQ_UQ));
+
+       __m256d err = _mm256_max_pd(_mm256_sub_pd(vq, _mm256_load_pd(&limits.max_position[i])),
+                                   _mm256_sub_pd(_mm256_load_pd(&limits.min_position[i]), vq));
+       __m256d nulled = _mm256_cmp_pd(err, bound, _CMP_GE_OQ);
+       __m256d scaled = _mm256_andnot_pd(nulled, _mm256_cmp_pd(err, zero, _CMP_GE_OQ));
+       __m256d scale = _mm256_min_pd(_mm256_max_pd(_mm256_div_pd(_mm256_sub_pd(bound, err), bound), zero), one);
+       __m256d ramped = _mm256_mul_pd(clamped, scale);
+
+       __m256d rate_limited = _mm256_cmp_pd(_mm256_and_pd(_mm256_sub_pd(ramped, vf), abs_mask), max_change, _CMP_GE_OQ);
+       __m256d slewed = _mm256_min_pd(_mm256_max_pd(ramped, _mm256_sub_pd(vf, max_change)), _mm256_add_pd(vf, max_change));
+
+       __m256d hard_cut = _mm256_or_pd(invalid, _mm256_cmp_pd(_mm256_and_pd(slewed, abs_mask), hard_limit, _CMP_NLT_UQ));
+       _mm256_storeu_pd(effort_out + i, _mm256_andnot_pd(hard_cut, slewed));
+
+       int clamped_bits = _mm256_movemask_pd(clamped_mask);
+       int scaled_bits = _mm256_movemask_pd(_mm256_andnot_pd(invalid, scaled));
+       int nulled_bits = _mm256_movemask_pd(_mm256_andnot_pd(invalid, nulled));
+       int rate_bits = _mm256_movemask_pd(_mm256_andnot_pd(invalid, rate_limited));
+       int hard_bits = _mm256_movemask_pd(hard_cut);
+       for (int j = 0; j < 4; j++)
+         events[i + j] = static_cast<uint8_t>(((clamped_bits >> j) & 1) * EFFORT_CLAMPED |
+                                              ((scaled_bits >> j) & 1) * EFFORT_SCALED_NEAR_LIMIT |
+                                              ((nulled_bits >> j) & 1) * EFFORT_NULLED_OUT_OF_RANGE |
+                                              ((rate_bits >> j) & 1) * EFFORT_RATE_LIMITED |
+                                              ((hard_bits >> j) & 1) * EFFORT_HARD_CUT);
+     }
+#elif defined(__SSE2__)
+     const __m128d zero = _mm_setzero_pd();
+     const __m128d one = _mm_set1_pd(1.0);
+     const __m128d abs_mask = _mm_castsi128_pd(_mm_set1_epi64x(0x7fffffffffffffffLL));
+     const __m128d bound = _mm_set1_pd(params.position_err_bound);
+     const __m128d max_change = _mm_set1_pd(params.max_change);
+     const __m128d hard_limit = _mm_set1_pd(params.hard_limit);
+     for (; i + 2 <= n; i += 2)
+     {
+       __m128d effort = _mm_load_pd(effort_in + i);
+       __m128d vq = _mm_load_pd(q + i);
+       __m128d vf = _mm_load_pd(f + i);
+       __m128d max_effort = _mm_load_pd(&limits.max_effort[i]);
+
+       __m128d invalid = _mm_or_pd(_mm_cmpunord_pd(effort, effort), _mm_cmpunord_pd(vq, vf));
+       __m128d clamped = _mm_min_pd(_mm_max_pd(effort, _mm_sub_pd(zero, max_effort)), max_effort);
+       __m128d clamped_mask = _mm_andnot_pd(invalid, _mm_cmpneq_pd(clamped, effort));
+
+       __m128d err = _mm_max_pd(_mm_sub_pd(vq, _mm_load_pd(&limits.max_position[i])),
+                                _mm_sub_pd(_mm_load_pd(&limits.min_position[i]), vq));
+       __m128d nulled = _mm_cmpge_pd(err, bound);
+       __m128d scaled = _mm_andnot_pd(nulled, _mm_cmpge_pd(err, zero));
+       __m128d scale = _mm_min_pd(_mm_max_pd(_mm_div_pd(_mm_sub_pd(bound, err), bound), zero), one);
+       __m128d ramped = _mm_mul_pd(clamped, scale);
+
+       __m128d rate_limited = _mm_cmpge_pd(_mm_and_pd(_mm_sub_pd(ramped, vf), abs_mask), max_change);
+       __m128d slewed = _mm_min_pd(_mm_max_pd(ramped, _mm_sub_pd(vf, max_change)), _mm_add_pd(vf, max_change));
+
+       __m128d hard_cut = _mm_or_pd(invalid, _mm_cmpnlt_pd(_mm_and_pd(slewed, abs_mask), hard_limit));
+       _mm_storeu_pd(effort_out + i, _mm_andnot_pd(hard_cut, slewed));
+
+       int clamped_bits = _mm_movemask_pd(clamped_mask);
+       int scaled_bits = _mm_movemask_pd(_mm_andnot_pd(invalid, scaled));
+       int nulled_bits = _mm_movemask_pd(_mm_andnot_pd(invalid, nulled));
+       int rate_bits = _mm_movemask_pd(_mm_andnot_pd(invalid, rate_limited));
+       int hard_bits = _mm_movemask_pd(hard_cut);
+       for (int j = 0; j < 2; j++)
+         events[i + j] = static_cast<uint8_t>(((clamped_bits >> j) & 1) * EFFORT_CLAMPED |
+                                              ((scaled_bits >> j) & 1) * EFFORT_SCALED_NEAR_LIMIT |
+                                              ((nulled_bits >> j) & 1) * EFFORT_NULLED_OUT_OF_RANGE |
+                                              ((rate_bits >> j) & 1) * EFFORT_RATE_LIMITED |
+                                              ((hard_bits >> j) & 1) * EFFORT_HARD_CUT);
+     }
+#endif
+     for (; i < n; i++)
+       events[i] = limitJointEffort(effort_in[i], q[i], f[i],
+                                    limits.min_position[i], limits.max_position[i], limits.max_effort[i],
+                                    params, effort_out + i);
+   }
+}
+#endif
@@ -0,0 +1,110 @@
+#ifndef HERMITESEGMENT_HPP
+#define HERMITESEGMENT_HPP
+
+#include <algorithm>
+#include <cmath>
+
+namespace valkyrie_translator
+{
+
+   /* Limits of a cubic Hermite segment from q0 at velocity v0 to q1 at
+      velocity v1, as trajectory waypoints and streamed goals are played
+      along. Its velocity is quadratic and its acceleration linear in time,
+      so both peaks have closed forms. */
+   class HermiteSegment
+   {
+   public:
+        // Shortest duration, at least duration, for which the segment's
+        // velocity stays within max_velocity, or within |v0| and |v1| where
+        // those are higher, and its acceleration within max_acceleration.
+        // Limits <= 0 do not constrain it. Should none fit, the duration that
+        // came closest.
+        static double minimumDuration(double q0, double v0, double q1, double v1, double max_velocity,
+                                      double max_acceleration, double duration)
+        {
+          duration = std::max(duration, 0.0);
+          if (duration > 0.0 && withinLimits(q0, v0, q1, v1, max_velocity, max_acceleration, duration))
+            return duration;
+          const double allowed_velocity =
+              max_velocity > 0.0 ? std::max(max_velocity, std::max(std::fabs(v0), std::fabs(v1))) : 0.0;
+
+          // Rest-to-rest peaks and the velocity change give a first guess
+          const double distance = std::fabs(q1 - q0);
+          double stretched = duration;
+          if (max_velocity > 0.0)
+            stretched = std::max(stretched, REST_TO_REST_PEAK_VELOCITY * distance / max_velocity);
+          if (max_acceleration > 0.0)
+          {
+            stretched = std::max(stretched, std::sqrt(REST_TO_REST_PEAK_ACCELERATION * distance / max_acceleration));
+            stretched = std::max(stretched, std::fabs(v1 - v0) / max_acceleration);
+          }
+          if (stretched <= 0.0)
+            return duration;
+
+          double best = stretched, best_excess = HUGE_VAL;
+          for (int attempt = 0; attempt < MAX_STRETCHES; attempt++, stretched *= STRETCH)
+          {
+            const double excess = limitExcess(q0, v0, q1, v1, allowed_velocity, max_acceleration, stretched);
+            if (excess <= 1.0 + LIMIT_TOLERANCE)
+              return stretched;
+            if (excess < best_excess)
+            {
+              best = stretched;
+              best_excess = excess;
+            }
+          }
+          return best;
+        }
+
+        // Whether the segment over T > 0 seconds stays within the limits, as
+        // for minimumDuration().
+        static bool withinLimits(double q0, double v0, double q1, double v1, double max_velocity,
+                                 double max_acceleration, double T)
+        {
+          const double allowed_velocity =
+              max_velocity > 0.0 ? std::max(max_velocity, std::max(std::fabs(v0), std::fabs(v1))) : 0.0;
+          return limitExcess(q0, v0, q1, v1, allowed_velocity, max_acceleration, T) <= 1.0 + LIMIT_TOLERANCE;
+        }
+
+        // Largest |velocity| and |acceleration| of the segment over T > 0 seconds.
+        static void peaks(double q0, double v0, double q1, double v1, double T, double& peak_velocity,
+                          double& peak_acceleration)
+        {
+          // Over s = t / T, T times the velocity is a s^2 + b s + m0, and T^2
+          // times the acceleration, its derivative, runs linearly from b to 2a + b.
+          const double m0 = v0 * T, m1 = v1 * T, d = q0 - q1;
+          const double a = 6.0 * d + 3.0 * m0 + 3.0 * m1;
+          const double b = -6.0 * d - 4.0 * m0 - 2.0 * m1;
+          double max_velocity = std::max(std::fabs(m0), std::fabs(m1));
+          if (a != 0.0)
+          {
+            const double s = -b / (2.0 * a);
+            if (s > 0.0 && s < 1.0)
+              max_velocity = std::max(max_velocity, std::fabs(m0 + s * (b + s * a)));
+          }
+          peak_velocity = max_velocity / T;
+          peak_acceleration = std::max(std::fabs(b), std::fabs(2.0 * a + b)) / (T * T);
+        }
+
+   private:
+        static constexpr double REST_TO_REST_PEAK_VELOCITY = 1.5;
+        static constexpr double REST_TO_REST_PEAK_ACCELERATION = 6.0;
+        static constexpr int MAX_STRETCHES = 40;
+        static constexpr double STRETCH = 1.2;
+        static constexpr double LIMIT_TOLERANCE = 1e-9;
+
+        static double limitExcess(double q0, double v0, double q1, double v1, double allowed_velocity,
+                                  double max_acceleration, double T)
+        {
+          double peak_velocity, peak_acceleration;
+          peaks(q0, v0, q1, v1, T, peak_velocity, peak_acceleration);
+          double excess = 0.0;
+          if (allowed_velocity > 0.0)
+            excess = std::max(excess, peak_velocity / allowed_velocity);
+          if (max_acceleration > 0.0)
+            excess = std::max(excess, peak_acceleration / max_acceleration);
+          return excess;
+        }
+   };
+}
+#endif
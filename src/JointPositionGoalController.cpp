@@ -19,6 +19,7 @@
 #include <vector>
 #include <set>
 #include <memory>
+#include <limits>
 
 #include <hardware_interface/joint_command_interface.h>
 #include <controller_interface/controller.h>
@@ -31,6 +32,19 @@
 #include "lcmtypes/bot_core/joint_state_t.hpp"
 #include "lcmtypes/bot_core/robot_state_t.hpp"
 #include "lcmtypes/bot_core/joint_angles_t.hpp"
+#include "lcmtypes/valkyrie_translator/joint_position_compact_t.hpp"
+#include "lcmtypes/valkyrie_translator/joint_trajectory_t.hpp"
+
+#include "ControllerTiming.hpp"
+#include "HermiteSegment.hpp"
+#include "JointSchemaAnnouncer.hpp"
+#include "LCMTransportHub.hpp"
+#include "OnlineTrajectory.hpp"
+#include "QuinticTrajectory.hpp"
+#include "RealtimeLCMPublisher.hpp"
+#include "RealtimeLog.hpp"
+#include "TripleBuffer.hpp"
+#include "WaypointQueue.hpp"
 
 inline double clamp(double x, double lower, double upper) {
     return std::max(lower, std::min(upper, x));
@@ -39,22 +53,61 @@ inline double clamp(double x, double lower, double upper) {
 namespace valkyrie_translator {
     class JointPositionGoalController;
 
+    // Event codes for the realtime logger
+    enum {
+        LOG_NEW_GOAL,
+        LOG_GOAL_SCHEMA_MISMATCH,
+        LOG_TRAJECTORY_REJECTED
+    };
+
+    // Latest position goal for every joint, indexed like joint_index_. A joint's
+    // sequence number is bumped each time a message mentions it, so goals are not
+    // lost if several messages arrive between two control ticks.
+    struct joint_position_goal_set {
+        std::vector<double> q_desired;
+        std::vector<uint32_t> sequence;
+    };
+
+    // Subscribes to the goal channel. With compact_commands set it also announces
+    // the joint_index_ order on <command_channel>_SCHEMA and accepts
+    // slot-addressed goals on <command_channel>_COMPACT. With accept_trajectories
+    // set it queues joint_trajectory_t waypoints from <command_channel>_TRAJECTORY.
     class JointPositionGoalController_LCMHandler {
     public:
-        explicit JointPositionGoalController_LCMHandler(JointPositionGoalController &parent,
-                                                        const std::string command_channel_in);
+        JointPositionGoalController_LCMHandler(JointPositionGoalController &parent,
+                                               const std::shared_ptr<LCMTransportHub> &hub,
+                                               const std::string command_channel_in);
 
         virtual ~JointPositionGoalController_LCMHandler();
 
         void jointPositionGoalHandler(const lcm::ReceiveBuffer *rbuf, const std::string &channel,
                                       const bot_core::joint_angles_t *msg);
 
-        void update();
+        void compactPositionGoalHandler(const lcm::ReceiveBuffer *rbuf, const std::string &channel,
+                                        const joint_position_compact_t *msg);
+
+        void jointTrajectoryHandler(const lcm::ReceiveBuffer *rbuf, const std::string &channel,
+                                    const joint_trajectory_t *msg);
+
+        void update(const ros::Time &time);
+
+        void announceSchema(int64_t utime);
+
+        void startReceiveThread();
+
+        void stopReceiveThread();
 
     private:
         JointPositionGoalController &parent_;
-        std::shared_ptr<lcm::LCM> lcm_;
+        std::shared_ptr<LCMTransportHub> hub_;
+        lcm::Subscription *subscription_;
+        lcm::Subscription *compact_subscription_;
+        lcm::Subscription *trajectory_subscription_;
+        std::unique_ptr<JointSchemaAnnouncer> goal_schema_;
+        bool receive_thread_requested_;
         std::string command_channel_;
+        joint_position_goal_set pending_goals_;
+        std::vector<int> trajectory_slots_;
     };
 
     class JointPositionGoalController
@@ -78,31 +131,135 @@ namespace valkyrie_translator {
                          std::set<std::string> &claimed_resources) override;
 
     private:
+        void initStateMessages();
+
         void publishEstimatedRobotStateToLCM(int64_t utime);
 
         void publishCoreRobotStateToLCM(int64_t utime);
 
         void publishCommandFeedbackToLCM(int64_t utime);
 
+        void applyNewGoals(const ros::Time &time);
+
+        void replanGoals();
+
+        void cancelWaypoints();
+
+        void advanceWaypoints(const ros::Time &time);
+
+        void beginWaypointSegment(double start, size_t available, bool &replan);
+
+        void evaluateWaypoints(double now);
+
+        void startStreamSegment(size_t i, double sample, bool restarted);
+
+        void evaluateStream(double now);
+
+        std::shared_ptr<LCMTransportHub> hub_;
         std::shared_ptr<lcm::LCM> lcm_;
         std::shared_ptr<JointPositionGoalController_LCMHandler> handler_;
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::robot_state_t> > est_robot_state_pub_;
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::joint_state_t> > core_robot_state_pub_;
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::joint_state_t> > command_feedback_pub_;
 
         std::vector<std::string> joint_names_;
         std::map<std::string, hardware_interface::JointHandle> positionJointHandles_;
+        std::map<std::string, size_t> joint_index_;
         size_t number_of_joint_interfaces_;
 
-        // Limits: joint position and velocity limits
-        std::map<std::string, joint_limits_interface::JointLimits> joint_limits_;
+        // Per-joint state, indexed by slot (the joint_index_ value) and built once
+        // in initRequest so update() and the publishers only walk arrays
+        std::vector<std::string> slot_names_;
+        std::vector<hardware_interface::JointHandle> slot_handles_;
+        std::vector<double> min_position_;
+        std::vector<double> max_position_;
+        std::vector<double> q_measured_;
+        std::vector<double> qd_measured_;
+        std::vector<double> q_last_commanded_;
+        std::vector<double> qd_commanded_;
+        std::vector<double> qdd_commanded_;
+        std::vector<double> q_desired_;
+        std::vector<double> q_trajectory_;
+
+        // Joints with has_acceleration_limits track q_desired_ through online_trajectory_,
+        // time-optimally within their velocity and acceleration limits. The others move
+        // together along trajectory_, replanned from the commanded state whenever
+        // goals arrive, over the shortest duration in which no joint's velocity
+        // peaks above quintic_max_velocity_ (its own velocity limit, or
+        // joint_velocity_limit without one) nor its acceleration above
+        // quintic_max_acceleration_ (joint_acceleration_limit). Both are 0 for
+        // online joints.
+        std::vector<uint8_t> online_;
+        std::vector<double> quintic_max_velocity_;
+        std::vector<double> quintic_max_acceleration_;
+        // Every joint's own limits, or joint_velocity_limit and joint_acceleration_limit
+        std::vector<double> joint_max_velocity_;
+        std::vector<double> joint_max_acceleration_;
+        QuinticTrajectory trajectory_;
+        OnlineTrajectory online_trajectory_;
+        ros::Time trajectory_start_;
+        // Time of the previous update(), i.e. of q_last_commanded_; replanned
+        // motions start there so the current tick already moves on
+        ros::Time previous_update_;
+
+        // Streamed multi-waypoint trajectories, only with accept_trajectories. The
+        // front waypoint is the one being approached: joints it names (driven_)
+        // follow a cubic Hermite segment from segment_from_ instead of the goal
+        // engines, and are handed back to them holding their last waypoint. A
+        // segment too fast for any of its joints' joint_max_velocity_ or
+        // joint_max_acceleration_ is stretched, delaying the rest of the queue;
+        // that includes the lead-in to a first waypoint at time 0.
+        bool accept_trajectories_;
+        WaypointQueue waypoints_;
+        size_t waypoints_scanned_;
+        bool segment_active_;
+        double segment_start_;
+        std::vector<uint8_t> driven_;
+        std::vector<double> segment_from_;
+        std::vector<double> segment_from_velocity_;
+        std::vector<double> segment_to_velocity_;
+
+        // Streaming mode (streaming_goals): every goal is a sample of a continuous
+        // setpoint stream. A joint with a new sample (streaming_) moves from its
+        // commanded state to the sample along a cubic Hermite segment, arriving
+        // with the sample-to-sample velocity as feedforward, over 1.25 estimated
+        // sample periods but at most streaming_max_latency, so a sample that is
+        // slightly late does not stop the joint. Segments are stretched where they
+        // would exceed the joint's velocity limit, and when samples stop coming
+        // the joint brakes from the feedforward velocity to rest at its
+        // acceleration limit. From the first sample of a stream on, until a
+        // segment would also be within its acceleration limit, the joint instead
+        // catches up (stream_catching_up_) along online_trajectory_, within both.
+        bool streaming_goals_;
+        double streaming_max_latency_;
+        double sample_period_;
+        double last_sample_time_;
+        std::vector<uint8_t> streaming_;
+        std::vector<uint8_t> stream_catching_up_;
+        std::vector<double> stream_from_;
+        std::vector<double> stream_from_velocity_;
+        std::vector<double> stream_to_;
+        std::vector<double> stream_velocity_;
+        std::vector<double> stream_sample_;
+        std::vector<double> stream_start_;
+        std::vector<double> stream_duration_;
+
+        // Goals decoded by the LCMHandler, picked up by update()
+        TripleBuffer<joint_position_goal_set> goal_mailbox_;
+        std::vector<uint32_t> applied_goal_sequence_;
+        bool use_receive_thread_;
+        bool compact_commands_;
+
+        // Keeps formatted logging out of the control and receive paths
+        std::unique_ptr<RealtimeLogger> logger_;
+
+        // Per-phase update() timing, only created when timing_stats_channel is set
+        std::unique_ptr<ControllerTiming> timing_;
+
+        // Limits: velocity limit for joints without their own in joint_limits, and
+        // acceleration limit for those without one
         double max_joint_velocity_;
-
-        std::map<std::string, double> q_measured_;
-        std::map<std::string, double> qd_measured_;
-        std::map<std::string, double> q_delta_;
-        std::map<std::string, double> q_start_;
-        std::map<std::string, double> q_last_commanded_;
-
-        double q_move_time_;
-        std::map<std::string, double> latest_commands_;
+        double max_joint_acceleration_;
 
         bool publish_est_robot_state_;
         std::string command_channel_;
@@ -113,13 +270,14 @@ namespace valkyrie_translator {
         uintmax_t control_state_publish_counter_;
 
         bool commands_modulate_on_joint_limits_range_;
-
-        ros::Time last_update_;
     };
 
     JointPositionGoalController::JointPositionGoalController() { }
 
-    JointPositionGoalController::~JointPositionGoalController() { }
+    JointPositionGoalController::~JointPositionGoalController() {
+        // unsubscribe from the shared hub before the members its handlers write to go away
+        handler_.reset();
+    }
 
     bool JointPositionGoalController::initRequest(hardware_interface::RobotHW *robot_hw,
                                                   ros::NodeHandle &root_nh, ros::NodeHandle &controller_nh,
@@ -156,14 +314,38 @@ namespace valkyrie_translator {
         ROS_INFO_STREAM("Publishing control state on LCM channel " << command_channel_ << " with " << control_state_publish_frequency_ << " Hz (every " << control_state_publish_every_tics_ << " tics)");
         control_state_publish_counter_ = 0;
 
-        // setup LCM
-        lcm_ = std::shared_ptr<lcm::LCM>(new lcm::LCM);
-        if (!lcm_->good()) {
-            std::cerr << "ERROR: lcm is not good()" << std::endl;
+        // setup LCM, shared with the other translator controllers in this process
+        hub_ = LCMTransportHub::acquire();
+        if (!hub_)
             return false;
+        lcm_ = hub_->lcm();
+
+        // Optionally report update() timing statistics
+        timing_ = ControllerTiming::fromParameters("JointPositionGoalController", lcm_, controller_nh);
+
+        // Determine whether to receive LCM on a separate thread instead of in update()
+        if (!controller_nh.getParam("lcm_receive_thread", use_receive_thread_)) {
+            ROS_WARN("Could not read desired setting for receiving LCM on a separate thread, defaulting to false");
+            use_receive_thread_ = false;
         }
-        handler_ = std::shared_ptr<JointPositionGoalController_LCMHandler>(
-                new JointPositionGoalController_LCMHandler(*this, command_channel_));
+
+        // Determine whether to also accept slot-addressed goals on <command_channel>_COMPACT
+        if (!controller_nh.getParam("compact_commands", compact_commands_))
+            compact_commands_ = false;
+
+        // Determine whether to accept multi-waypoint trajectories on <command_channel>_TRAJECTORY
+        if (!controller_nh.getParam("accept_trajectories", accept_trajectories_))
+            accept_trajectories_ = false;
+        int trajectory_capacity = 64;
+        controller_nh.getParam("trajectory_capacity", trajectory_capacity);
+
+        // Determine whether goals are a continuous setpoint stream rather than individual moves
+        if (!controller_nh.getParam("streaming_goals", streaming_goals_))
+            streaming_goals_ = false;
+        if (!controller_nh.getParam("streaming_max_latency", streaming_max_latency_) || streaming_max_latency_ <= 0.0)
+            streaming_max_latency_ = 0.1;
+        if (streaming_goals_)
+            ROS_INFO_STREAM("Treating goals as a setpoint stream, adding at most " << streaming_max_latency_ << "s latency");
 
         // Determine whether to publish EST_ROBOT_STATE
         if (!controller_nh.getParam("publish_est_robot_state", publish_est_robot_state_)) {
@@ -194,14 +376,19 @@ namespace valkyrie_translator {
             max_joint_velocity_ = 0.175;  // Default to 0.175rad/s (10deg/s) if not set
         }
         ROS_INFO_STREAM("Maximum joint velocity: " << max_joint_velocity_ << "rad/s");
+        // Default to reaching that velocity within a quarter of a second
+        if (!controller_nh.getParam("joint_acceleration_limit", max_joint_acceleration_))
+            max_joint_acceleration_ = 4.0 * max_joint_velocity_;
+        ROS_INFO_STREAM("Maximum joint acceleration: " << max_joint_acceleration_ << "rad/s^2");
 
         // Retrieve joint limits from parameter server
+        std::map<std::string, joint_limits_interface::JointLimits> joint_limits;
         for (auto const &joint_name : joint_names_) {
             joint_limits_interface::JointLimits limits;
             if (!getJointLimits(joint_name, controller_nh, limits))
                 ROS_ERROR_STREAM("Cannot read joint limits for joint " << joint_name << " from param server");
 
-            joint_limits_.insert(std::make_pair(joint_name, limits));
+            joint_limits.insert(std::make_pair(joint_name, limits));
             ROS_INFO_STREAM("Joint Position Limits: " << joint_name << " has lower limit " << limits.min_position <<
                             " and upper limit " <<
                             limits.max_position);
@@ -227,14 +414,89 @@ namespace valkyrie_translator {
 
             try {
                 positionJointHandles_[positionNames[i]] = position_hw->getHandle(positionNames[i]);
-                latest_commands_[positionNames[i]] = 0.0;
                 ROS_INFO_STREAM("I see a position interface for " << positionNames[i] << " and I claimed it.");
             } catch (const hardware_interface::HardwareInterfaceException& e) {
                 ROS_ERROR_STREAM("Could not retrieve handle for " << positionNames[i] << ": " << e.what());
             }
         }
         number_of_joint_interfaces_ = positionJointHandles_.size();
-        q_move_time_ = 0;
+
+        // Index joints in iteration order, lay out the per-slot state and preallocate the goal mailbox.
+        // Joints without limits on the param server get default-constructed (all zero) limits;
+        // joint_velocity_limit and joint_acceleration_limit bound joints without limits of their own.
+        online_trajectory_.resize(number_of_joint_interfaces_);
+        for (auto iter = positionJointHandles_.begin(); iter != positionJointHandles_.end(); iter++) {
+            size_t slot = joint_index_.size();
+            joint_index_.insert(std::make_pair(iter->first, slot));
+            slot_names_.push_back(iter->first);
+            slot_handles_.push_back(iter->second);
+            const joint_limits_interface::JointLimits &limits = joint_limits[iter->first];
+            min_position_.push_back(limits.min_position);
+            max_position_.push_back(limits.max_position);
+
+            double max_velocity = limits.has_velocity_limits ? limits.max_velocity : max_joint_velocity_;
+            bool online = limits.has_acceleration_limits && limits.max_acceleration > 0.0;
+            online_.push_back(online);
+            quintic_max_velocity_.push_back(online ? 0.0 : max_velocity);
+            quintic_max_acceleration_.push_back(online ? 0.0 : max_joint_acceleration_);
+            joint_max_velocity_.push_back(max_velocity);
+            joint_max_acceleration_.push_back(online ? limits.max_acceleration : max_joint_acceleration_);
+            online_trajectory_.setLimits(slot, joint_max_velocity_[slot], joint_max_acceleration_[slot]);
+            if (online) {
+                ROS_INFO_STREAM(iter->first << " follows goals online, limited to " << max_velocity << "rad/s and "
+                                << limits.max_acceleration << "rad/s^2");
+            }
+        }
+        q_measured_.assign(number_of_joint_interfaces_, 0.0);
+        qd_measured_.assign(number_of_joint_interfaces_, 0.0);
+        q_last_commanded_.assign(number_of_joint_interfaces_, 0.0);
+        qd_commanded_.assign(number_of_joint_interfaces_, 0.0);
+        qdd_commanded_.assign(number_of_joint_interfaces_, 0.0);
+        q_desired_.assign(number_of_joint_interfaces_, 0.0);
+        q_trajectory_.assign(number_of_joint_interfaces_, 0.0);
+        trajectory_.resize(number_of_joint_interfaces_);
+        waypoints_.reset(accept_trajectories_ ? std::max(trajectory_capacity, 1) : 1, number_of_joint_interfaces_);
+        waypoints_scanned_ = 0;
+        segment_active_ = false;
+        segment_start_ = 0.0;
+        driven_.assign(number_of_joint_interfaces_, 0);
+        segment_from_.assign(number_of_joint_interfaces_, 0.0);
+        segment_from_velocity_.assign(number_of_joint_interfaces_, 0.0);
+        segment_to_velocity_.assign(number_of_joint_interfaces_, 0.0);
+        sample_period_ = streaming_max_latency_;
+        last_sample_time_ = 0.0;
+        streaming_.assign(number_of_joint_interfaces_, 0);
+        stream_from_.assign(number_of_joint_interfaces_, 0.0);
+        stream_from_velocity_.assign(number_of_joint_interfaces_, 0.0);
+        stream_to_.assign(number_of_joint_interfaces_, 0.0);
+        stream_velocity_.assign(number_of_joint_interfaces_, 0.0);
+        stream_sample_.assign(number_of_joint_interfaces_, 0.0);
+        stream_catching_up_.assign(number_of_joint_interfaces_, 0);
+        stream_start_.assign(number_of_joint_interfaces_, 0.0);
+        stream_duration_.assign(number_of_joint_interfaces_, 0.0);
+
+        // extra names past the joints, for events about the compact and trajectory channels themselves
+        std::vector<std::string> log_names(slot_names_);
+        log_names.push_back(command_channel_ + "_COMPACT");
+        log_names.push_back(command_channel_ + "_TRAJECTORY");
+        logger_.reset(new RealtimeLogger(log_names));
+        logger_->registerEvent(LOG_NEW_GOAL, "%s got new q_desired %f");
+        logger_->registerEvent(LOG_GOAL_SCHEMA_MISMATCH, "%s: rejected goals built for a different joint table (hash %lld)");
+        logger_->registerEvent(LOG_TRAJECTORY_REJECTED, "%s: dropped a trajectory of %.0f waypoints, only %.0f free");
+        logger_->start();
+
+        joint_position_goal_set initial_goals;
+        initial_goals.q_desired.assign(number_of_joint_interfaces_, 0.0);
+        initial_goals.sequence.assign(number_of_joint_interfaces_, 0);
+        goal_mailbox_.reset(initial_goals);
+        applied_goal_sequence_.assign(number_of_joint_interfaces_, 0);
+        initStateMessages();
+
+        handler_ = std::shared_ptr<JointPositionGoalController_LCMHandler>(
+                new JointPositionGoalController_LCMHandler(*this, hub_, command_channel_));
+        // the thread is created and joined here and by the handler's destructor, never on the realtime thread
+        if (use_receive_thread_)
+            handler_->startReceiveThread();
 
         auto position_hw_claims = position_hw->getClaims();
         claimed_resources.insert(position_hw_claims.begin(), position_hw_claims.end());
@@ -249,55 +511,73 @@ namespace valkyrie_translator {
     }
 
     void JointPositionGoalController::starting(const ros::Time &time) {
-        last_update_ = time;
+        if (accept_trajectories_)
+            cancelWaypoints();
+        streaming_.assign(number_of_joint_interfaces_, 0);
+        last_sample_time_ = 0.0;
+
+        // Hold the current position until the first goal arrives
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            q_last_commanded_[i] = slot_handles_[i].getPosition();
+            qd_commanded_[i] = 0.0;
+            qdd_commanded_[i] = 0.0;
+            online_trajectory_.reset(i, q_last_commanded_[i]);
+        }
+        q_desired_ = q_last_commanded_;
+        trajectory_.plan(q_last_commanded_.data(), qd_commanded_.data(), qdd_commanded_.data(),
+                         q_desired_.data(), 0.0);
+        trajectory_start_ = time;
+        previous_update_ = time;
     }
 
     void JointPositionGoalController::update(const ros::Time &time, const ros::Duration &period) {
-        handler_->update();
-        lcm_->handleTimeout(0);
+        if (timing_)
+            timing_->beginCycle(time);
+
+        if (!use_receive_thread_)
+            handler_->update(time);
+
+        if (goal_mailbox_.consume())
+            applyNewGoals(time);
+        if (accept_trajectories_)
+            advanceWaypoints(time);
+        if (timing_)
+            timing_->mark(ControllerTiming::PHASE_INBOUND);
 
-        double dt = (time - last_update_).toSec();
         int64_t utime = (int64_t) (time.toSec() * 1e6);
 
+        if (compact_commands_)
+            handler_->announceSchema(utime);
+
+        trajectory_.evaluate((time - trajectory_start_).toSec(), q_trajectory_.data(),
+                             qd_commanded_.data(), qdd_commanded_.data());
+        online_trajectory_.step(period.toSec());
+        const std::vector<double> &q_online = online_trajectory_.position();
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            if (online_[i]) {
+                q_trajectory_[i] = q_online[i];
+                qd_commanded_[i] = online_trajectory_.velocity()[i];
+                qdd_commanded_[i] = online_trajectory_.acceleration()[i];
+            }
+        }
+        if (streaming_goals_)
+            evaluateStream(time.toSec());
+        if (accept_trajectories_)
+            evaluateWaypoints(time.toSec());
+
         // Iterate over all position-controlled joints
-        for (auto iter = positionJointHandles_.begin(); iter != positionJointHandles_.end(); iter++) {
-            std::string joint_name = iter->first;
-            double &q = q_measured_[joint_name];
-            q = iter->second.getPosition();
-            double &qd = qd_measured_[joint_name];
-            qd = iter->second.getVelocity();
-
-            double &q_desired = latest_commands_[iter->first];
-            double &q_delta = q_delta_[joint_name];
-            double &q_start = q_start_[joint_name];
-
-            double eta;
-            if (q_move_time_ > 0.0)
-                eta = std::max(0.0, std::min(1.0, dt / q_move_time_));
-            else
-                eta = 0.0;
-            double q_command = eta * q_desired + (1 - eta) * q_start;
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            q_measured_[i] = slot_handles_[i].getPosition();
+            qd_measured_[i] = slot_handles_[i].getVelocity();
 
             // Check that new position is within joint position limits, enforce by clamping
-            joint_limits_interface::JointLimits &limits = joint_limits_[joint_name];
-            double q_command_with_position_limits_enforced = clamp(q_command, limits.min_position,
-                                                                   limits.max_position);
-
-            double &q_last_commanded = q_last_commanded_[joint_name];
-            q_last_commanded = q_command_with_position_limits_enforced;
-
-//            std::cout << joint_name << std::endl;
-//            std::cout << "q: " << q << std::endl;
-//            std::cout << "q_desired: " << q_desired << std::endl;
-//            std::cout << "q_start: " << q_start << std::endl;
-//            std::cout << "q_command: " << q_command << std::endl;
-//            std::cout << "q_command_with_position_limits_enforced: " << q_command_with_position_limits_enforced <<
-//            std::endl;
-//            std::cout << std::endl;
+            q_last_commanded_[i] = clamp(q_trajectory_[i], min_position_[i], max_position_[i]);
 
             // Write command to joint
-            iter->second.setCommand(q_command_with_position_limits_enforced);
+            slot_handles_[i].setCommand(q_last_commanded_[i]);
         }
+        if (timing_)
+            timing_->mark(ControllerTiming::PHASE_COMMAND);
 
         // Throttle output according to control_state_publish_frequency_
         if (control_state_publish_counter_ % control_state_publish_every_tics_ == 0) {
@@ -308,21 +588,321 @@ namespace valkyrie_translator {
 
         if (publish_est_robot_state_)
             publishEstimatedRobotStateToLCM(utime);
+
+        if (timing_) {
+            timing_->mark(ControllerTiming::PHASE_PUBLISH);
+            timing_->endCycle();
+        }
+        previous_update_ = time;
     }
 
     void JointPositionGoalController::stopping(const ros::Time &time) { }
 
-    void JointPositionGoalController::publishEstimatedRobotStateToLCM(int64_t utime) {
+    void JointPositionGoalController::applyNewGoals(const ros::Time &time) {
+        const joint_position_goal_set &goals = goal_mailbox_.readBuffer();
+
+        // Goals take over from any trajectory already playing
+        if (accept_trajectories_)
+            cancelWaypoints();
+
+        // Track the stream rate; a long gap starts a new stream from rest
+        bool stream_restarted = false;
+        if (streaming_goals_) {
+            const double now = time.toSec();
+            const double interval = now - last_sample_time_;
+            if (last_sample_time_ > 0.0 && interval < 4.0 * streaming_max_latency_)
+                sample_period_ += 0.1 * (interval - sample_period_);
+            else
+                stream_restarted = true;
+            last_sample_time_ = now;
+        }
+
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            if (goals.sequence[i] == applied_goal_sequence_[i])
+                continue;
+            applied_goal_sequence_[i] = goals.sequence[i];
+
+            if (commands_modulate_on_joint_limits_range_)
+                q_desired_[i] = goals.q_desired[i] * (max_position_[i] - min_position_[i]) + min_position_[i];
+            else
+                q_desired_[i] = goals.q_desired[i];
+
+            if (streaming_goals_)
+                startStreamSegment(i, q_desired_[i], stream_restarted);
+            else if (online_[i])
+                online_trajectory_.setTarget(i, q_desired_[i]);
+        }
+
+        replanGoals();
+    }
+
+    void JointPositionGoalController::replanGoals() {
+        // Replan the quintic group from the commanded position, velocity and
+        // acceleration so the move starts smoothly even mid-trajectory. Joints
+        // without a new goal keep heading for their old one, and all of them
+        // arrive together, as soon as their limits allow. A joint still moving
+        // needs time to stop even when its goal is where it is now.
+        double duration = QuinticTrajectory::minimumDuration(q_last_commanded_.data(), qd_commanded_.data(),
+                                                             qdd_commanded_.data(), q_desired_.data(),
+                                                             quintic_max_velocity_.data(),
+                                                             quintic_max_acceleration_.data(),
+                                                             number_of_joint_interfaces_);
+        trajectory_.plan(q_last_commanded_.data(), qd_commanded_.data(), qdd_commanded_.data(),
+                         q_desired_.data(), duration);
+        trajectory_start_ = previous_update_;
+    }
+
+    void JointPositionGoalController::cancelWaypoints() {
+        // Driven joints stop following the trajectory where they are commanded now
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            if (!driven_[i])
+                continue;
+            driven_[i] = 0;
+            q_desired_[i] = q_last_commanded_[i];
+            online_trajectory_.reset(i, q_last_commanded_[i], qd_commanded_[i]);
+        }
+        // Waypoints that arrive after the goals still play afterwards
+        waypoints_.pop(waypoints_scanned_);
+        waypoints_scanned_ = 0;
+        segment_active_ = false;
+    }
+
+    void JointPositionGoalController::advanceWaypoints(const ros::Time &time) {
+        const double now = time.toSec();
+        bool replan = false;
+
+        // Give newly arrived waypoints their absolute arrival time. A trajectory
+        // that does not append replaces everything queued before it.
+        size_t available = waypoints_.size();
+        double motion_start = now;
+        for (size_t k = waypoints_scanned_; k < available; k++) {
+            uint8_t flags = waypoints_.flags(k);
+            if (flags & WaypointQueue::STARTS_MOTION) {
+                if (!(flags & WaypointQueue::APPEND) && k > 0) {
+                    waypoints_.pop(k);
+                    available -= k;
+                    k = 0;
+                    segment_active_ = false;
+                }
+                motion_start = (flags & WaypointQueue::APPEND) && k > 0 ? waypoints_.arrivalTime(k - 1) : now;
+            }
+            waypoints_.arrivalTime(k) = motion_start + waypoints_.time(k);
+        }
+        waypoints_scanned_ = available;
+
+        // A new motion starts from wherever the joints are commanded
+        if (available > 0 && !segment_active_) {
+            for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+                segment_from_[i] = q_last_commanded_[i];
+                segment_from_velocity_[i] = qd_commanded_[i];
+            }
+            beginWaypointSegment(previous_update_.toSec(), available, replan);
+        }
+
+        // Move past every waypoint that is due
+        while (segment_active_ && now >= waypoints_.arrivalTime(0)) {
+            const double *reached = waypoints_.position(0);
+            const double reached_time = waypoints_.arrivalTime(0);
+            for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+                if (driven_[i]) {
+                    segment_from_[i] = reached[i];
+                    segment_from_velocity_[i] = segment_to_velocity_[i];
+                } else {
+                    segment_from_[i] = q_last_commanded_[i];
+                    segment_from_velocity_[i] = qd_commanded_[i];
+                }
+            }
+            waypoints_.pop(1);
+            available--;
+            waypoints_scanned_--;
+
+            if (available > 0) {
+                beginWaypointSegment(reached_time, available, replan);
+            } else {
+                // trajectory finished: hold the last waypoint
+                for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+                    if (!driven_[i])
+                        continue;
+                    driven_[i] = 0;
+                    q_desired_[i] = segment_from_[i];
+                    online_trajectory_.reset(i, segment_from_[i], segment_from_velocity_[i]);
+                    replan = true;
+                }
+                segment_active_ = false;
+            }
+        }
+
+        if (replan)
+            replanGoals();
+    }
+
+    void JointPositionGoalController::beginWaypointSegment(double start, size_t available, bool &replan) {
+        const double *to = waypoints_.position(0);
+        const double *next = available > 1 ? waypoints_.position(1) : nullptr;
+        const double next_time = available > 1 ? waypoints_.arrivalTime(1) : 0.0;
+
+        segment_start_ = start;
+        segment_active_ = true;
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            if (std::isnan(to[i])) {
+                // not part of this segment: back to the goal engines, holding its last waypoint
+                if (driven_[i]) {
+                    driven_[i] = 0;
+                    q_desired_[i] = segment_from_[i];
+                    online_trajectory_.reset(i, segment_from_[i], segment_from_velocity_[i]);
+                    replan = true;
+                }
+                continue;
+            }
+            driven_[i] = 1;
+            streaming_[i] = 0;
+
+            // Look ahead: pass through the waypoint at the Catmull-Rom velocity if
+            // the one after it is already queued, otherwise arrive at rest
+            if (next && !std::isnan(next[i]) && next_time > start)
+                segment_to_velocity_[i] = clamp((next[i] - segment_from_[i]) / (next_time - start),
+                                                -joint_max_velocity_[i], joint_max_velocity_[i]);
+            else
+                segment_to_velocity_[i] = 0.0;
+        }
+
+        // Stretch the segment until it is within every driven joint's limits and
+        // delay everything queued after it by as much
+        const double planned = waypoints_.arrivalTime(0) - start;
+        double duration = planned;
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            if (driven_[i])
+                duration = HermiteSegment::minimumDuration(segment_from_[i], segment_from_velocity_[i], to[i],
+                                                           segment_to_velocity_[i], joint_max_velocity_[i],
+                                                           joint_max_acceleration_[i], duration);
+        }
+        if (duration > planned) {
+            for (size_t k = 0; k < available; k++)
+                waypoints_.arrivalTime(k) += duration - planned;
+        }
+    }
+
+    void JointPositionGoalController::evaluateWaypoints(double now) {
+        if (!segment_active_)
+            return;
+
+        const double *to = waypoints_.position(0);
+        const double duration = waypoints_.arrivalTime(0) - segment_start_;
+        double s = duration > 0.0 ? (now - segment_start_) / duration : 1.0;
+        s = clamp(s, 0.0, 1.0);
+
+        // cubic Hermite basis and its derivatives with respect to s
+        const double s2 = s * s, s3 = s2 * s;
+        const double h00 = 2 * s3 - 3 * s2 + 1, h10 = s3 - 2 * s2 + s, h01 = -2 * s3 + 3 * s2, h11 = s3 - s2;
+        const double d00 = 6 * s2 - 6 * s, d10 = 3 * s2 - 4 * s + 1, d01 = -d00, d11 = 3 * s2 - 2 * s;
+        const double dd00 = 12 * s - 6, dd10 = 6 * s - 4, dd01 = -dd00, dd11 = 6 * s - 2;
+        const double T = duration > 0.0 ? duration : 1.0;
+
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            if (!driven_[i])
+                continue;
+            const double p0 = segment_from_[i], p1 = to[i];
+            const double m0 = segment_from_velocity_[i] * T, m1 = segment_to_velocity_[i] * T;
+            q_trajectory_[i] = h00 * p0 + h10 * m0 + h01 * p1 + h11 * m1;
+            qd_commanded_[i] = (d00 * p0 + d10 * m0 + d01 * p1 + d11 * m1) / T;
+            qdd_commanded_[i] = (dd00 * p0 + dd10 * m0 + dd01 * p1 + dd11 * m1) / (T * T);
+        }
+    }
+
+    void JointPositionGoalController::startStreamSegment(size_t i, double sample, bool restarted) {
+        // feedforward from the last two samples, none for the first sample of a stream
+        const bool continuing = streaming_[i] && !restarted;
+        const double velocity = continuing && sample_period_ > 0.0
+                                    ? clamp((sample - stream_sample_[i]) / sample_period_, -joint_max_velocity_[i],
+                                            joint_max_velocity_[i])
+                                    : 0.0;
+        const double latency = clamp(1.25 * sample_period_, 0.001, streaming_max_latency_);
+        stream_sample_[i] = sample;
+        streaming_[i] = 1;
+
+        // A new stream is caught up with within all the joint's limits, until a
+        // segment at the usual latency would be within them too
+        const bool catching_up = !continuing || stream_catching_up_[i];
+        if (catching_up && !HermiteSegment::withinLimits(q_last_commanded_[i], qd_commanded_[i], sample, velocity,
+                                                         joint_max_velocity_[i], joint_max_acceleration_[i],
+                                                         latency)) {
+            if (!continuing)
+                online_trajectory_.reset(i, q_last_commanded_[i], qd_commanded_[i]);
+            online_trajectory_.setTarget(i, sample);
+            stream_catching_up_[i] = 1;
+            return;
+        }
+        stream_catching_up_[i] = 0;
+
+        stream_velocity_[i] = velocity;
+        stream_from_[i] = q_last_commanded_[i];
+        stream_from_velocity_[i] = qd_commanded_[i];
+        stream_to_[i] = sample;
+        stream_start_[i] = previous_update_.toSec();
+        // then the stream sets the pace, as long as the joint's velocity stays within its limit
+        stream_duration_[i] = HermiteSegment::minimumDuration(stream_from_[i], stream_from_velocity_[i], sample,
+                                                              velocity, joint_max_velocity_[i], 0.0, latency);
+    }
+
+    void JointPositionGoalController::evaluateStream(double now) {
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            if (!streaming_[i])
+                continue;
+            if (stream_catching_up_[i]) {
+                q_trajectory_[i] = online_trajectory_.position()[i];
+                qd_commanded_[i] = online_trajectory_.velocity()[i];
+                qdd_commanded_[i] = online_trajectory_.acceleration()[i];
+                continue;
+            }
+            double s = (now - stream_start_[i]) / stream_duration_[i];
+            if (s >= 1.0 && stream_velocity_[i] != 0.0 && joint_max_acceleration_[i] > 0.0) {
+                // the stream has stalled: rather than dropping the feedforward at
+                // once, brake to rest at the acceleration limit, past the last sample
+                const double v = stream_velocity_[i];
+                const double braking = std::fabs(v) / joint_max_acceleration_[i];
+                stream_start_[i] += stream_duration_[i];
+                stream_from_[i] = stream_to_[i];
+                stream_from_velocity_[i] = v;
+                stream_to_[i] += 0.5 * v * braking;
+                stream_velocity_[i] = 0.0;
+                stream_duration_[i] = braking;
+                s = (now - stream_start_[i]) / braking;
+            }
+            if (s >= 1.0) {
+                // then hold where it stopped
+                q_trajectory_[i] = stream_to_[i];
+                qd_commanded_[i] = 0.0;
+                qdd_commanded_[i] = 0.0;
+                continue;
+            }
+
+            const double T = stream_duration_[i];
+            const double s2 = s * s, s3 = s2 * s;
+            const double p0 = stream_from_[i], p1 = stream_to_[i];
+            const double m0 = stream_from_velocity_[i] * T, m1 = stream_velocity_[i] * T;
+            q_trajectory_[i] = (2 * s3 - 3 * s2 + 1) * p0 + (s3 - 2 * s2 + s) * m0 + (-2 * s3 + 3 * s2) * p1 + (s3 - s2) * m1;
+            qd_commanded_[i] = ((6 * s2 - 6 * s) * (p0 - p1) + (3 * s2 - 4 * s + 1) * m0 + (3 * s2 - 2 * s) * m1) / T;
+            qdd_commanded_[i] = ((12 * s - 6) * (p0 - p1) + (6 * s - 4) * m0 + (6 * s - 2) * m1) / (T * T);
+        }
+    }
+
+    void JointPositionGoalController::initStateMessages() {
+        // Sizes, joint names and constant fields are filled in once here; the
+        // publish helpers only write utime and the numeric per-joint fields.
+        est_robot_state_pub_.reset(new RealtimeLCMPublisher<bot_core::robot_state_t>(lcm_, "EST_ROBOT_STATE"));
+        core_robot_state_pub_.reset(new RealtimeLCMPublisher<bot_core::joint_state_t>(lcm_, control_state_channel_));
+        command_feedback_pub_.reset(new RealtimeLCMPublisher<bot_core::joint_state_t>(lcm_, command_feedback_channel_));
+
         // EST_ROBOT_STATE
         // need to decide what message we're really using for state. for now,
         // assembling this to make director happy
-        bot_core::robot_state_t lcm_state_msg;
-        lcm_state_msg.utime = utime;
+        bot_core::robot_state_t &lcm_state_msg = est_robot_state_pub_->msg_;
+        lcm_state_msg.utime = 0;
         lcm_state_msg.num_joints = (int16_t) number_of_joint_interfaces_;
-        lcm_state_msg.joint_name.assign(number_of_joint_interfaces_, "");
-        lcm_state_msg.joint_position.assign(number_of_joint_interfaces_, (const float &) 0.);
-        lcm_state_msg.joint_velocity.assign(number_of_joint_interfaces_, (const float &) 0.);
-        lcm_state_msg.joint_effort.assign(number_of_joint_interfaces_, (const float &) 0.);
+        lcm_state_msg.joint_name = slot_names_;
+        lcm_state_msg.joint_position.assign(number_of_joint_interfaces_, 0.0f);
+        lcm_state_msg.joint_velocity.assign(number_of_joint_interfaces_, 0.0f);
+        lcm_state_msg.joint_effort.assign(number_of_joint_interfaces_, 0.0f);
         lcm_state_msg.pose.translation.x = 0.0;
         lcm_state_msg.pose.translation.y = 0.0;
         lcm_state_msg.pose.translation.z = 0.0;
@@ -337,121 +917,214 @@ namespace valkyrie_translator {
         lcm_state_msg.twist.angular_velocity.y = 0.0;
         lcm_state_msg.twist.angular_velocity.z = 0.0;
 
-        unsigned int positionJointIndex = 0;
-        for (auto const &joint_name : joint_names_) {
-            lcm_state_msg.joint_name[positionJointIndex] = joint_name;
-            lcm_state_msg.joint_position[positionJointIndex] = static_cast<float>(q_measured_[joint_name]);
-            lcm_state_msg.joint_velocity[positionJointIndex] = static_cast<float>(qd_measured_[joint_name]);
-            positionJointIndex++;
+        // CORE_ROBOT_STATE (or control_state_channel)
+        bot_core::joint_state_t &lcm_pose_msg = core_robot_state_pub_->msg_;
+        lcm_pose_msg.utime = 0;
+        lcm_pose_msg.num_joints = (int16_t) number_of_joint_interfaces_;
+        lcm_pose_msg.joint_name = slot_names_;
+        lcm_pose_msg.joint_position.assign(number_of_joint_interfaces_, 0.0f);
+        lcm_pose_msg.joint_velocity.assign(number_of_joint_interfaces_, 0.0f);
+        lcm_pose_msg.joint_effort.assign(number_of_joint_interfaces_, 0.0f);
+
+        // VAL_COMMAND_FEEDBACK (or command_feedback_channel)
+        bot_core::joint_state_t &lcm_commanded_msg = command_feedback_pub_->msg_;
+        lcm_commanded_msg.utime = 0;
+        lcm_commanded_msg.num_joints = (int16_t) number_of_joint_interfaces_;
+        lcm_commanded_msg.joint_name = slot_names_;
+        lcm_commanded_msg.joint_position.assign(number_of_joint_interfaces_, 0.0f);
+        lcm_commanded_msg.joint_velocity.assign(number_of_joint_interfaces_, 0.0f);
+        lcm_commanded_msg.joint_effort.assign(number_of_joint_interfaces_, 0.0f);
+    }
+
+    void JointPositionGoalController::publishEstimatedRobotStateToLCM(int64_t utime) {
+        if (!est_robot_state_pub_->trylock())
+            return;
+        bot_core::robot_state_t &lcm_state_msg = est_robot_state_pub_->msg_;
+        lcm_state_msg.utime = utime;
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            lcm_state_msg.joint_position[i] = static_cast<float>(q_measured_[i]);
+            lcm_state_msg.joint_velocity[i] = static_cast<float>(qd_measured_[i]);
         }
 
-        lcm_->publish("EST_ROBOT_STATE", &lcm_state_msg);
+        est_robot_state_pub_->unlockAndPublish();
     }
 
     void JointPositionGoalController::publishCoreRobotStateToLCM(int64_t utime) {
         // CORE_ROBOT_STATE, pushes out the joint states for all joints
-        bot_core::joint_state_t lcm_pose_msg;
+        if (!core_robot_state_pub_->trylock())
+            return;
+        bot_core::joint_state_t &lcm_pose_msg = core_robot_state_pub_->msg_;
         lcm_pose_msg.utime = utime;
-        lcm_pose_msg.num_joints = (int16_t) number_of_joint_interfaces_;
-        lcm_pose_msg.joint_name.assign(number_of_joint_interfaces_, "");
-        lcm_pose_msg.joint_position.assign(number_of_joint_interfaces_, (const float &) 0.);
-        lcm_pose_msg.joint_velocity.assign(number_of_joint_interfaces_, (const float &) 0.);
-        lcm_pose_msg.joint_effort.assign(number_of_joint_interfaces_, (const float &) 0.);
-
-        unsigned int positionJointIndex = 0;
-        for (auto const &joint_name : joint_names_) {
-            lcm_pose_msg.joint_name[positionJointIndex] = joint_name;
-
-            if (commands_modulate_on_joint_limits_range_){            
-                joint_limits_interface::JointLimits &limits = joint_limits_[joint_name];
-                lcm_pose_msg.joint_position[positionJointIndex] = static_cast<float>(
-                    clamp((q_measured_[joint_name]-limits.min_position) / (limits.max_position - limits.min_position), 0.0, 1.0));
-            }
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++) {
+            if (commands_modulate_on_joint_limits_range_)
+                lcm_pose_msg.joint_position[i] = static_cast<float>(
+                    clamp((q_measured_[i] - min_position_[i]) / (max_position_[i] - min_position_[i]), 0.0, 1.0));
             else
-                lcm_pose_msg.joint_position[positionJointIndex] = static_cast<float>(q_measured_[joint_name]);
+                lcm_pose_msg.joint_position[i] = static_cast<float>(q_measured_[i]);
 
-            lcm_pose_msg.joint_velocity[positionJointIndex] = static_cast<float>(qd_measured_[joint_name]);
-            positionJointIndex++;
+            lcm_pose_msg.joint_velocity[i] = static_cast<float>(qd_measured_[i]);
         }
 
-        lcm_->publish(control_state_channel_.c_str(), &lcm_pose_msg);
+        core_robot_state_pub_->unlockAndPublish();
     }
 
     void JointPositionGoalController::publishCommandFeedbackToLCM(int64_t utime) {
         // VAL_COMMAND_FEEDBACK, republishes actual commanded position to guarantee sync
-        bot_core::joint_state_t lcm_commanded_msg;
+        if (!command_feedback_pub_->trylock())
+            return;
+        bot_core::joint_state_t &lcm_commanded_msg = command_feedback_pub_->msg_;
         lcm_commanded_msg.utime = utime;
-        lcm_commanded_msg.num_joints = (int16_t) number_of_joint_interfaces_;
-        lcm_commanded_msg.joint_name.assign(number_of_joint_interfaces_, "");
-        lcm_commanded_msg.joint_position.assign(number_of_joint_interfaces_, (const float &) 0.);
-        lcm_commanded_msg.joint_velocity.assign(number_of_joint_interfaces_, (const float &) 0.);
-        lcm_commanded_msg.joint_effort.assign(number_of_joint_interfaces_, (const float &) 0.);
+        for (size_t i = 0; i < number_of_joint_interfaces_; i++)
+            lcm_commanded_msg.joint_position[i] = static_cast<float>(q_last_commanded_[i]);
 
-        unsigned int positionJointIndex = 0;
-        for (auto const &joint_name : joint_names_) {
-            lcm_commanded_msg.joint_name[positionJointIndex] = joint_name;
-            lcm_commanded_msg.joint_position[positionJointIndex] = static_cast<float>(q_last_commanded_[joint_name]);
-            positionJointIndex++;
-        }
-
-        lcm_->publish(command_feedback_channel_.c_str(), &lcm_commanded_msg);
+        command_feedback_pub_->unlockAndPublish();
     }
 
     JointPositionGoalController_LCMHandler::JointPositionGoalController_LCMHandler(JointPositionGoalController &parent,
+                                                                                   const std::shared_ptr<LCMTransportHub> &hub,
                                                                                    const std::string command_channel_in)
-            : parent_(parent), command_channel_(command_channel_in) {
-        lcm_ = std::shared_ptr<lcm::LCM>(new lcm::LCM);
-        if (!lcm_->good()) {
-            std::cerr << "ERROR: handler lcm is not good()" << std::endl;
-        }
+            : parent_(parent), hub_(hub), compact_subscription_(nullptr), trajectory_subscription_(nullptr),
+              receive_thread_requested_(false),
+              command_channel_(command_channel_in) {
+        pending_goals_.q_desired.assign(parent_.number_of_joint_interfaces_, 0.0);
+        pending_goals_.sequence.assign(parent_.number_of_joint_interfaces_, 0);
 
         std::cout << "Subscribing to " << command_channel_in << std::endl;
-        lcm_->subscribe(command_channel_in, &JointPositionGoalController_LCMHandler::jointPositionGoalHandler,
-                        this);
+        subscription_ = hub_->subscribe(command_channel_in,
+                                        &JointPositionGoalController_LCMHandler::jointPositionGoalHandler, this);
+
+        if (parent_.compact_commands_) {
+            // slot i is joint_index_ == i, i.e. the map's iteration order
+            std::vector<std::string> slot_names;
+            for (auto iter = parent_.joint_index_.begin(); iter != parent_.joint_index_.end(); iter++)
+                slot_names.push_back(iter->first);
+            goal_schema_.reset(new JointSchemaAnnouncer(hub_->lcm(), command_channel_in + "_SCHEMA", slot_names));
+            std::cout << "Subscribing to " << command_channel_in << "_COMPACT" << std::endl;
+            compact_subscription_ = hub_->subscribe(command_channel_in + "_COMPACT",
+                                                    &JointPositionGoalController_LCMHandler::compactPositionGoalHandler, this);
+        }
+
+        if (parent_.accept_trajectories_) {
+            std::cout << "Subscribing to " << command_channel_in << "_TRAJECTORY" << std::endl;
+            trajectory_subscription_ = hub_->subscribe(command_channel_in + "_TRAJECTORY",
+                                                       &JointPositionGoalController_LCMHandler::jointTrajectoryHandler, this);
+        }
     }
 
-    JointPositionGoalController_LCMHandler::~JointPositionGoalController_LCMHandler() { }
+    JointPositionGoalController_LCMHandler::~JointPositionGoalController_LCMHandler() {
+        stopReceiveThread();
+        hub_->unsubscribe(subscription_);
+        if (compact_subscription_)
+            hub_->unsubscribe(compact_subscription_);
+        if (trajectory_subscription_)
+            hub_->unsubscribe(trajectory_subscription_);
+    }
 
     void JointPositionGoalController_LCMHandler::jointPositionGoalHandler(const lcm::ReceiveBuffer *rbuf,
                                                                           const std::string &channel,
                                                                           const bot_core::joint_angles_t *msg) {
-        // Reset q_move_time_
-        parent_.q_move_time_ = 0.0;
-        parent_.last_update_ = ros::Time::now();
-
         // Iterate over all received joints
         for (unsigned int i = 0; i < msg->num_joints; ++i) {
-            auto search = parent_.latest_commands_.find(msg->joint_name[i]);
-            if (search != parent_.latest_commands_.end()) {
-                std::string joint_name = msg->joint_name[i];
-                ROS_INFO_STREAM(joint_name << " got new q_desired " << msg->joint_position[i]);
+            auto search = parent_.joint_index_.find(msg->joint_name[i]);
+            if (search != parent_.joint_index_.end()) {
+                parent_.logger_->log(LOG_NEW_GOAL, search->second, msg->joint_position[i]);
+                pending_goals_.q_desired[search->second] = msg->joint_position[i];
+                pending_goals_.sequence[search->second]++;
+            }
+        }
+
+        // Hand the goals over to update(), which starts the ramp
+        parent_.goal_mailbox_.writeBuffer() = pending_goals_;
+        parent_.goal_mailbox_.publish();
+    }
+
+    void JointPositionGoalController_LCMHandler::compactPositionGoalHandler(const lcm::ReceiveBuffer *rbuf,
+                                                                            const std::string &channel,
+                                                                            const joint_position_compact_t *msg) {
+        // Slots are only meaningful against the table we announced
+        if (msg->schema_hash != goal_schema_->hash()) {
+            parent_.logger_->logInteger(LOG_GOAL_SCHEMA_MISMATCH, parent_.number_of_joint_interfaces_,
+                                        msg->schema_hash);
+            return;
+        }
+
+        const size_t num_slots = parent_.number_of_joint_interfaces_;
+        for (int i = 0; i < msg->num_joints; ++i) {
+            size_t slot = static_cast<uint16_t>(msg->slot[i]);
+            if (slot >= num_slots)
+                continue;
+            parent_.logger_->log(LOG_NEW_GOAL, slot, msg->joint_position[i]);
+            pending_goals_.q_desired[slot] = msg->joint_position[i];
+            pending_goals_.sequence[slot]++;
+        }
+
+        parent_.goal_mailbox_.writeBuffer() = pending_goals_;
+        parent_.goal_mailbox_.publish();
+    }
 
-                double &q_desired = parent_.latest_commands_[joint_name];
+    void JointPositionGoalController_LCMHandler::jointTrajectoryHandler(const lcm::ReceiveBuffer *rbuf,
+                                                                        const std::string &channel,
+                                                                        const joint_trajectory_t *msg) {
+        WaypointQueue &queue = parent_.waypoints_;
+        const size_t num_points = msg->num_points > 0 ? msg->num_points : 0;
+        if (num_points == 0)
+            return;
+        // a replacing trajectory does not need the space of the one it replaces
+        const size_t space = queue.space(msg->append);
+        if (num_points > space) {
+            parent_.logger_->log(LOG_TRAJECTORY_REJECTED, parent_.number_of_joint_interfaces_ + 1,
+                                 num_points, space);
+            return;
+        }
 
+        trajectory_slots_.resize(msg->num_joints);
+        for (int j = 0; j < msg->num_joints; j++) {
+            auto search = parent_.joint_index_.find(msg->joint_name[j]);
+            trajectory_slots_[j] = search != parent_.joint_index_.end() ? static_cast<int>(search->second) : -1;
+        }
 
-                joint_limits_interface::JointLimits &limits = parent_.joint_limits_[joint_name];
+        // Joints the message does not name stay NaN, i.e. not driven
+        double previous_time = 0.0;
+        for (size_t p = 0; p < num_points; p++) {
+            double *position = queue.newPosition(p);
+            std::fill(position, position + parent_.number_of_joint_interfaces_, std::numeric_limits<double>::quiet_NaN());
+            for (int j = 0; j < msg->num_joints; j++) {
+                int slot = trajectory_slots_[j];
+                if (slot < 0)
+                    continue;
+                double q = msg->joint_position[p][j];
                 if (parent_.commands_modulate_on_joint_limits_range_)
-                    q_desired = msg->joint_position[i] * (limits.max_position - limits.min_position) + limits.min_position;
-                else
-                    q_desired = msg->joint_position[i];
-
-                // ramp between last commanded value and new commanded value
-                double &q_last_commanded = parent_.q_last_commanded_[joint_name];
-                double &q_delta = parent_.q_delta_[joint_name];
-                q_delta = q_desired - q_last_commanded;
-                double &q_start = parent_.q_start_[joint_name];
-                q_start = q_last_commanded;
-
-                // Calculate move time for joint, set controller q_move_time_ to largest value
-                double tmp_q_move_time = std::fabs(q_delta) / parent_.max_joint_velocity_;
-                if (tmp_q_move_time > parent_.q_move_time_)
-                    parent_.q_move_time_ = tmp_q_move_time;
+                    q = q * (parent_.max_position_[slot] - parent_.min_position_[slot]) + parent_.min_position_[slot];
+                position[slot] = q;
             }
+            previous_time = std::max(previous_time, static_cast<double>(msg->time_from_start[p]));
+            queue.newTime(p) = previous_time;
+            queue.newFlags(p) = p > 0 ? 0 : WaypointQueue::STARTS_MOTION | (msg->append ? WaypointQueue::APPEND : 0);
         }
+        queue.commit(num_points);
+    }
+
+    void JointPositionGoalController_LCMHandler::update(const ros::Time &time) {
+        hub_->poll(time);
+    }
+
+    void JointPositionGoalController_LCMHandler::announceSchema(int64_t utime) {
+        if (goal_schema_)
+            goal_schema_->announce(utime);
+    }
+
+    void JointPositionGoalController_LCMHandler::startReceiveThread() {
+        if (receive_thread_requested_)
+            return;
+        receive_thread_requested_ = true;
+        hub_->startReceiveThread();
     }
 
-    void JointPositionGoalController_LCMHandler::update() {
-        lcm_->handleTimeout(0);
+    void JointPositionGoalController_LCMHandler::stopReceiveThread() {
+        if (!receive_thread_requested_)
+            return;
+        receive_thread_requested_ = false;
+        hub_->stopReceiveThread();
     }
 }  // namespace valkyrie_translator
 
@@ -0,0 +1,28 @@
+#ifndef JOINTSCHEMA_HPP
+#define JOINTSCHEMA_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace valkyrie_translator
+{
+
+   /* Identifies an ordered list of joint names (see joint_schema_t): 64-bit
+      FNV-1a over every name followed by a NUL byte. */
+   inline int64_t jointSchemaHash(const std::vector<std::string>& joint_names)
+   {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < joint_names.size(); i++)
+    {
+      const std::string& name = joint_names[i];
+      for (size_t c = 0; c <= name.size(); c++)  // includes the terminating NUL
+      {
+        hash ^= static_cast<unsigned char>(name.c_str()[c]);
+        hash *= 0x100000001b3ULL;
+      }
+    }
+    return static_cast<int64_t>(hash);
+   }
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef JOINTSCHEMAANNOUNCER_HPP
+#define JOINTSCHEMAANNOUNCER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <lcm/lcm-cpp.hpp>
+#include "lcmtypes/valkyrie_translator/joint_schema_t.hpp"
+
+#include "JointSchema.hpp"
+#include "RealtimeLCMPublisher.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Publishes a joint order as a joint_schema_t: on the first call to
+      announce() and about once a second after that, so late subscribers
+      pick it up. announce() is realtime safe and meant to be called every
+      tick. */
+   class JointSchemaAnnouncer
+   {
+   public:
+        JointSchemaAnnouncer(const std::shared_ptr<lcm::LCM>& lcm, const std::string& channel,
+                             const std::vector<std::string>& joint_names)
+          : pub_(lcm, channel), announced_(false)
+        {
+          joint_schema_t& schema = pub_.msg_;
+          schema.utime = 0;
+          schema.schema_hash = jointSchemaHash(joint_names);
+          schema.num_joints = static_cast<int16_t>(joint_names.size());
+          schema.joint_name = joint_names;
+        }
+
+        int64_t hash() const { return pub_.msg_.schema_hash; }
+
+        void announce(int64_t utime)
+        {
+          std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+          if ((!announced_ || now - last_announcement_ >= std::chrono::seconds(1)) && pub_.trylock())
+          {
+            pub_.msg_.utime = utime;
+            pub_.unlockAndPublish();
+            announced_ = true;
+            last_announcement_ = now;
+          }
+        }
+
+   private:
+        RealtimeLCMPublisher<joint_schema_t> pub_;
+        bool announced_;
+        std::chrono::steady_clock::time_point last_announcement_;
+   };
+}
+#endif
@@ -20,7 +20,15 @@
 #include "lcmtypes/bot_core/six_axis_force_torque_array_t.hpp"
 #include "lcmtypes/bot_core/ins_t.hpp"
 #include "lcmtypes/bot_core/joint_angles_t.hpp"
+#include "lcmtypes/valkyrie_translator/robot_state_bundle_t.hpp"
 
+#include "CompactJointStatePublisher.hpp"
+#include "ControllerTiming.hpp"
+#include "JointSchemaAnnouncer.hpp"
+#include "LCMTransportHub.hpp"
+#include "PublishScheduler.hpp"
+#include "RealtimeLCMPublisher.hpp"
+#include "SharedStateWriter.hpp"
 
 namespace valkyrie_translator {
     class JointStatePublisher;
@@ -49,20 +57,50 @@ namespace valkyrie_translator {
 
         void publishCoreRobotState(int64_t utime);
 
+        void publishAggregatedState(int64_t utime, uint64_t tick);
+
+        void writeSharedState(int64_t utime);
+
         std::vector<std::string> joint_names_;
         std::vector<hardware_interface::JointStateHandle> joint_state_handles_;
         std::map<std::string, hardware_interface::ImuSensorHandle> imu_sensor_handles_;
         std::map<std::string, hardware_interface::ForceTorqueSensorHandle> force_torque_handles_;
+        std::shared_ptr<LCMTransportHub> hub_;
         std::shared_ptr<lcm::LCM> lcm_;
         unsigned int number_of_joint_interfaces_;
 
-        bot_core::joint_state_t core_robot_state_;
-        bot_core::robot_state_t est_robot_state_;
+        // Messages are preallocated inside their publishers and encoded/sent off the RT thread
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::joint_state_t> > core_robot_state_pub_;
+        // Replaces core_robot_state_pub_ when compact_core_robot_state is set
+        std::unique_ptr<CompactJointStatePublisher> compact_core_robot_state_pub_;
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::robot_state_t> > est_robot_state_pub_;
+        std::vector<std::shared_ptr<RealtimeLCMPublisher<bot_core::ins_t> > > imu_pubs_;  // same order as imu_sensor_handles_
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::six_axis_force_torque_array_t> > force_torque_pub_;
+        // Joints, IMUs and force-torque sensors of one tick in one message (opt-in), named by
+        // the joint_schema_t on <aggregated_state_channel>_SCHEMA
+        std::unique_ptr<RealtimeLCMPublisher<robot_state_bundle_t> > aggregated_state_pub_;
+        std::unique_ptr<JointSchemaAnnouncer> aggregated_state_schema_;
         std::string core_robot_state_channel_;
 
+        // Same state for consumers on this host, only opened when shared_state_name is set
+        std::unique_ptr<SharedStateWriter> shared_state_;
+
+        // Per-cycle update() timing, only created when timing_stats_channel is set
+        std::unique_ptr<ControllerTiming> timing_;
+
+        bool publish_core_robot_state_;
         bool publish_imu_readings_;
         bool publish_separate_force_torque_readings_;
         bool publish_est_robot_state_;
+        bool publish_aggregated_state_;
+
+        // Per-channel publish rates and phases (<channel>_publish_frequency / _phase)
+        std::unique_ptr<PublishScheduler> schedule_;
+        size_t core_robot_state_schedule_;
+        size_t est_robot_state_schedule_;
+        size_t force_torque_schedule_;
+        size_t aggregated_state_schedule_;
+        std::vector<size_t> imu_schedules_;  // same order as imu_sensor_handles_
     };
 
 
@@ -89,60 +127,67 @@ namespace valkyrie_translator {
 
         number_of_joint_interfaces_ = static_cast<unsigned int>(joint_names_.size());
 
-        // Setup LCM
-        lcm_ = std::shared_ptr<lcm::LCM>(new lcm::LCM);
-        if (!lcm_->good()) {
-            std::cerr << "ERROR: lcm is not good()" << std::endl;
+        // Setup LCM, shared with the other translator controllers in this process
+        hub_ = LCMTransportHub::acquire();
+        if (!hub_)
             return false;
-        }
+        lcm_ = hub_->lcm();
 
         // Retrieve channel name for the core robot state message (defaults to CORE_ROBOT_STATE)
         if (!controller_nh.getParam("core_robot_state_channel", core_robot_state_channel_))
             core_robot_state_channel_ = "CORE_ROBOT_STATE";
         ROS_INFO_STREAM("Publishing core robot state to " << core_robot_state_channel_);
 
+        // Optionally report update() timing statistics
+        timing_ = ControllerTiming::fromParameters("JointStatePublisher", lcm_, controller_nh);
+
+        core_robot_state_pub_.reset(new RealtimeLCMPublisher<bot_core::joint_state_t>(lcm_, core_robot_state_channel_));
+        est_robot_state_pub_.reset(new RealtimeLCMPublisher<bot_core::robot_state_t>(lcm_, "EST_ROBOT_STATE"));
+        bot_core::joint_state_t &core_robot_state = core_robot_state_pub_->msg_;
+        bot_core::robot_state_t &est_robot_state = est_robot_state_pub_->msg_;
+
         // Initialise core robot state message
-        core_robot_state_.utime = 0;
-        core_robot_state_.num_joints = static_cast<int16_t>(number_of_joint_interfaces_);
-        core_robot_state_.joint_name.assign(number_of_joint_interfaces_, "");
-        core_robot_state_.joint_position.assign(number_of_joint_interfaces_, (const float &) 0.);
-        core_robot_state_.joint_velocity.assign(number_of_joint_interfaces_, (const float &) 0.);
-        core_robot_state_.joint_effort.assign(number_of_joint_interfaces_, (const float &) 0.);
+        core_robot_state.utime = 0;
+        core_robot_state.num_joints = static_cast<int16_t>(number_of_joint_interfaces_);
+        core_robot_state.joint_name.assign(number_of_joint_interfaces_, "");
+        core_robot_state.joint_position.assign(number_of_joint_interfaces_, (const float &) 0.);
+        core_robot_state.joint_velocity.assign(number_of_joint_interfaces_, (const float &) 0.);
+        core_robot_state.joint_effort.assign(number_of_joint_interfaces_, (const float &) 0.);
 
         // Initialise robot state message
-        est_robot_state_.utime = 0;
-        est_robot_state_.num_joints = static_cast<int16_t>(number_of_joint_interfaces_);
-        est_robot_state_.joint_name.assign(number_of_joint_interfaces_, "");
-        est_robot_state_.joint_position.assign(number_of_joint_interfaces_, (const float &) 0.);
-        est_robot_state_.joint_velocity.assign(number_of_joint_interfaces_, (const float &) 0.);
-        est_robot_state_.joint_effort.assign(number_of_joint_interfaces_, (const float &) 0.);
-        est_robot_state_.pose.translation.x = 0.0;
-        est_robot_state_.pose.translation.y = 0.0;
-        est_robot_state_.pose.translation.z = 0.0;
-        est_robot_state_.pose.rotation.w = 1.0;
-        est_robot_state_.pose.rotation.x = 0.0;
-        est_robot_state_.pose.rotation.y = 0.0;
-        est_robot_state_.pose.rotation.z = 0.0;
-        est_robot_state_.twist.linear_velocity.x = 0.0;
-        est_robot_state_.twist.linear_velocity.y = 0.0;
-        est_robot_state_.twist.linear_velocity.z = 0.0;
-        est_robot_state_.twist.angular_velocity.x = 0.0;
-        est_robot_state_.twist.angular_velocity.y = 0.0;
-        est_robot_state_.twist.angular_velocity.z = 0.0;
+        est_robot_state.utime = 0;
+        est_robot_state.num_joints = static_cast<int16_t>(number_of_joint_interfaces_);
+        est_robot_state.joint_name.assign(number_of_joint_interfaces_, "");
+        est_robot_state.joint_position.assign(number_of_joint_interfaces_, (const float &) 0.);
+        est_robot_state.joint_velocity.assign(number_of_joint_interfaces_, (const float &) 0.);
+        est_robot_state.joint_effort.assign(number_of_joint_interfaces_, (const float &) 0.);
+        est_robot_state.pose.translation.x = 0.0;
+        est_robot_state.pose.translation.y = 0.0;
+        est_robot_state.pose.translation.z = 0.0;
+        est_robot_state.pose.rotation.w = 1.0;
+        est_robot_state.pose.rotation.x = 0.0;
+        est_robot_state.pose.rotation.y = 0.0;
+        est_robot_state.pose.rotation.z = 0.0;
+        est_robot_state.twist.linear_velocity.x = 0.0;
+        est_robot_state.twist.linear_velocity.y = 0.0;
+        est_robot_state.twist.linear_velocity.z = 0.0;
+        est_robot_state.twist.angular_velocity.x = 0.0;
+        est_robot_state.twist.angular_velocity.y = 0.0;
+        est_robot_state.twist.angular_velocity.z = 0.0;
 
         // Initialise F/T sensors in est_robot_state_
-        est_robot_state_.force_torque.l_foot_force_z = 0.0;
-        est_robot_state_.force_torque.l_foot_torque_x = 0.0;
-        est_robot_state_.force_torque.l_foot_torque_y = 0.0;
-        est_robot_state_.force_torque.r_foot_force_z = 0.0;
-        est_robot_state_.force_torque.r_foot_torque_x = 0.0;
-        est_robot_state_.force_torque.r_foot_torque_y = 0.0;
+        est_robot_state.force_torque.l_foot_force_z = 0.0;
+        est_robot_state.force_torque.l_foot_torque_x = 0.0;
+        est_robot_state.force_torque.l_foot_torque_y = 0.0;
+        est_robot_state.force_torque.r_foot_force_z = 0.0;
+        est_robot_state.force_torque.r_foot_torque_x = 0.0;
+        est_robot_state.force_torque.r_foot_torque_y = 0.0;
 
         for (unsigned int i = 0; i < 3; i++) {
-            est_robot_state_.force_torque.l_hand_force[i] = 0.0;
-            est_robot_state_.force_torque.l_hand_torque[i] = 0.0;
-            est_robot_state_.force_torque.r_hand_force[i] = 0.0;
-            est_robot_state_.force_torque.r_hand_torque[i] = 0.0;
+            est_robot_state.force_torque.l_hand_force[i] = 0.0;
+            est_robot_state.force_torque.l_hand_torque[i] = 0.0;
+            est_robot_state.force_torque.r_hand_force[i] = 0.0;
+            est_robot_state.force_torque.r_hand_torque[i] = 0.0;
         }
 
         // Retrieve joint handles and init est_robot_state_msg_
@@ -150,13 +195,34 @@ namespace valkyrie_translator {
             try {
                 // ROS_INFO_STREAM("Joint " << joint_names_[i]);
                 joint_state_handles_.push_back(hw->getHandle(joint_names_[i]));
-                est_robot_state_.joint_name[i] = joint_names_[i];
-                core_robot_state_.joint_name[i] = joint_names_[i];
+                est_robot_state.joint_name[i] = joint_names_[i];
+                core_robot_state.joint_name[i] = joint_names_[i];
             } catch (const hardware_interface::HardwareInterfaceException& e) {
                 ROS_ERROR_STREAM("Could not retrieve handle for " << joint_names_[i] << ": " << e.what());
             }
         }
 
+        // Retrieve parameter whether to publish all state of a tick in one message, which
+        // replaces CORE_ROBOT_STATE, the IMU_* channels and FORCE_TORQUE
+        if (!controller_nh.getParam("publish_aggregated_state", publish_aggregated_state_))
+            publish_aggregated_state_ = false;
+        ROS_INFO_STREAM("Publishing aggregated state: " << std::to_string(publish_aggregated_state_));
+
+        // Retrieve parameter whether to publish the core robot state
+        if (!controller_nh.getParam("publish_core_robot_state", publish_core_robot_state_))
+            publish_core_robot_state_ = true;
+        if (publish_aggregated_state_)
+            publish_core_robot_state_ = false;
+        ROS_INFO_STREAM("Publishing " << core_robot_state_channel_ << ": " << std::to_string(publish_core_robot_state_));
+
+        // Retrieve parameter whether to publish the core robot state without joint names
+        // (on <core_robot_state_channel>_COMPACT, named by <core_robot_state_channel>_SCHEMA)
+        bool compact_core_robot_state = false;
+        controller_nh.getParam("compact_core_robot_state", compact_core_robot_state);
+        if (compact_core_robot_state)
+            compact_core_robot_state_pub_.reset(
+                    new CompactJointStatePublisher(lcm_, core_robot_state_channel_, joint_names_));
+
         // Retrieve parameter whether to publish EST_ROBOT_STATE (robot_state_t)
         if (!controller_nh.getParam("publish_est_robot_state", publish_est_robot_state_))
             publish_est_robot_state_ = true;
@@ -165,9 +231,11 @@ namespace valkyrie_translator {
         // Retrieve parameter whether to publish IMU sensor readings
         if (!controller_nh.getParam("publish_imu_readings", publish_imu_readings_))
             publish_imu_readings_ = true;
+        if (publish_aggregated_state_)
+            publish_imu_readings_ = false;
         ROS_INFO_STREAM("Publishing IMU readings: " << std::to_string(publish_imu_readings_));
 
-        if (publish_imu_readings_) {
+        if (publish_imu_readings_ || publish_aggregated_state_) {
             // Retrieve the IMU sensor interface
             hardware_interface::ImuSensorInterface *imu_hw = robot_hw->get<hardware_interface::ImuSensorInterface>();
             if (!imu_hw) {
@@ -184,11 +252,25 @@ namespace valkyrie_translator {
                     ROS_ERROR_STREAM("Could not retrieve handle for " << imu_names[i] << ": " << e.what());
                 }
             }
+
+            for (auto it = imu_sensor_handles_.begin(); it != imu_sensor_handles_.end() && publish_imu_readings_; it++) {
+                std::shared_ptr<RealtimeLCMPublisher<bot_core::ins_t> > imu_pub(
+                        new RealtimeLCMPublisher<bot_core::ins_t>(lcm_, "IMU_" + it->first));
+                imu_pub->msg_.utime = 0;
+                imu_pub->msg_.mag[0] = 0.0;
+                imu_pub->msg_.mag[1] = 0.0;
+                imu_pub->msg_.mag[2] = 0.0;
+                imu_pub->msg_.pressure = 0.0;
+                imu_pub->msg_.rel_alt = 0.0;
+                imu_pubs_.push_back(imu_pub);
+            }
         }
 
         // Retrieve parameter whether to publish separate force-torque sensor readings in addition to EST_ROBOT_STATE
         if (!controller_nh.getParam("publish_separate_force_torque_readings", publish_separate_force_torque_readings_))
             publish_separate_force_torque_readings_ = false;
+        if (publish_aggregated_state_)
+            publish_separate_force_torque_readings_ = false;
         ROS_INFO_STREAM("Publishing separate FORCE_TORQUE readings: " <<
                         std::to_string(publish_separate_force_torque_readings_));
 
@@ -210,6 +292,88 @@ namespace valkyrie_translator {
             }
         }
 
+        force_torque_pub_.reset(new RealtimeLCMPublisher<bot_core::six_axis_force_torque_array_t>(lcm_, "FORCE_TORQUE"));
+        force_torque_pub_->msg_.utime = 0;
+        force_torque_pub_->msg_.num_sensors = 2;
+        force_torque_pub_->msg_.names.resize(2);
+        force_torque_pub_->msg_.sensors.resize(2);
+        force_torque_pub_->msg_.names[0] = "l_foot";
+        force_torque_pub_->msg_.names[1] = "r_foot";
+
+        // Set up the publish schedule against the rate update() is called at: each
+        // channel's rate and phase come from <channel>_publish_frequency (default:
+        // every tick, <= 0: never) and <channel>_publish_phase (default: spread out
+        // automatically)
+        double update_frequency = 500.0;
+        controller_nh.getParam("update_frequency", update_frequency);
+        if (!(update_frequency > 0.0)) {
+            ROS_ERROR_STREAM("update_frequency must be positive, got " << update_frequency);
+            return false;
+        }
+        schedule_.reset(new PublishScheduler(update_frequency));
+        auto add_channel = [&](const std::string &param_prefix, const std::string &channel) {
+            double frequency = update_frequency;
+            int phase = -1;
+            controller_nh.getParam(param_prefix + "_publish_frequency", frequency);
+            controller_nh.getParam(param_prefix + "_publish_phase", phase);
+            return schedule_->add(channel, frequency, phase);
+        };
+        if (publish_core_robot_state_)
+            core_robot_state_schedule_ = add_channel("core_robot_state", core_robot_state_channel_);
+        if (publish_est_robot_state_)
+            est_robot_state_schedule_ = add_channel("est_robot_state", "EST_ROBOT_STATE");
+        for (auto it = imu_sensor_handles_.begin(); it != imu_sensor_handles_.end() && publish_imu_readings_; it++)
+            imu_schedules_.push_back(add_channel("imu", "IMU_" + it->first));
+        if (publish_separate_force_torque_readings_)
+            force_torque_schedule_ = add_channel("force_torque", "FORCE_TORQUE");
+
+        if (publish_aggregated_state_) {
+            std::string aggregated_state_channel;
+            if (!controller_nh.getParam("aggregated_state_channel", aggregated_state_channel))
+                aggregated_state_channel = "VAL_ROBOT_STATE_BUNDLE";
+            aggregated_state_schedule_ = add_channel("aggregated_state", aggregated_state_channel);
+
+            aggregated_state_pub_.reset(new RealtimeLCMPublisher<robot_state_bundle_t>(lcm_, aggregated_state_channel));
+            // the names go out on the schema channel instead of in every message
+            std::vector<std::string> schema_names(joint_names_);
+            for (auto it = imu_sensor_handles_.begin(); it != imu_sensor_handles_.end(); it++)
+                schema_names.push_back(it->first);
+            for (auto it = force_torque_handles_.begin(); it != force_torque_handles_.end(); it++)
+                schema_names.push_back(it->first);
+            aggregated_state_schema_.reset(
+                    new JointSchemaAnnouncer(lcm_, aggregated_state_channel + "_SCHEMA", schema_names));
+
+            robot_state_bundle_t &bundle = aggregated_state_pub_->msg_;
+            bundle.utime = 0;
+            bundle.tick = 0;
+            bundle.schema_hash = aggregated_state_schema_->hash();
+            bundle.num_joints = static_cast<int16_t>(number_of_joint_interfaces_);
+            bundle.joint_position.assign(number_of_joint_interfaces_, 0.0f);
+            bundle.joint_velocity.assign(number_of_joint_interfaces_, 0.0f);
+            bundle.joint_effort.assign(number_of_joint_interfaces_, 0.0f);
+            bundle.num_imus = static_cast<int16_t>(imu_sensor_handles_.size());
+            bundle.imu_orientation.assign(imu_sensor_handles_.size(), std::vector<float>(4, 0.0f));
+            bundle.imu_angular_velocity.assign(imu_sensor_handles_.size(), std::vector<float>(3, 0.0f));
+            bundle.imu_linear_acceleration.assign(imu_sensor_handles_.size(), std::vector<float>(3, 0.0f));
+            bundle.num_force_torques = static_cast<int16_t>(force_torque_handles_.size());
+            bundle.force.assign(force_torque_handles_.size(), std::vector<float>(3, 0.0f));
+            bundle.torque.assign(force_torque_handles_.size(), std::vector<float>(3, 0.0f));
+        }
+
+        // Optionally export joint, IMU and force-torque state to shared memory
+        std::string shared_state_name;
+        if (controller_nh.getParam("shared_state_name", shared_state_name) && !shared_state_name.empty()) {
+            std::vector<std::string> imu_names, force_torque_names;
+            for (auto it = imu_sensor_handles_.begin(); it != imu_sensor_handles_.end(); it++)
+                imu_names.push_back(it->first);
+            for (auto it = force_torque_handles_.begin(); it != force_torque_handles_.end(); it++)
+                force_torque_names.push_back(it->first);
+            shared_state_.reset(new SharedStateWriter);
+            if (!shared_state_->open(shared_state_name, joint_names_, imu_names, force_torque_names))
+                return false;
+            ROS_INFO_STREAM("Exporting state to shared memory " << shared_state_name);
+        }
+
         state_ = INITIALIZED;
         return true;
     }
@@ -217,62 +381,106 @@ namespace valkyrie_translator {
     void JointStatePublisher::starting(const ros::Time &time) { }
 
     void JointStatePublisher::update(const ros::Time &time, const ros::Duration &period) {
-        lcm_->handleTimeout(0);
+        if (timing_)
+            timing_->beginCycle(time);
+
         int64_t utime = static_cast<int64_t>(time.toSec() * 1e6);
 
-        publishCoreRobotState(utime);
+        if (publish_core_robot_state_ && schedule_->due(core_robot_state_schedule_))
+            publishCoreRobotState(utime);
 
-        if (publish_est_robot_state_)
+        if (publish_est_robot_state_ && schedule_->due(est_robot_state_schedule_))
             publishEstRobotState(utime);
 
         if (publish_imu_readings_)
             publishIMUReadings(utime);
 
-        if (publish_separate_force_torque_readings_)
+        if (publish_separate_force_torque_readings_ && schedule_->due(force_torque_schedule_))
             publishForceTorqueReadings(utime);
+
+        if (publish_aggregated_state_ && schedule_->due(aggregated_state_schedule_))
+            publishAggregatedState(utime, schedule_->tick());
+
+        schedule_->advance();
+
+        if (shared_state_)
+            writeSharedState(utime);
+
+        if (timing_) {
+            timing_->mark(ControllerTiming::PHASE_PUBLISH);
+            timing_->endCycle();
+        }
     }
 
     void JointStatePublisher::publishEstRobotState(int64_t utime) {
-        est_robot_state_.utime = utime;
+        if (!est_robot_state_pub_->trylock())
+            return;
+
+        bot_core::robot_state_t &est_robot_state = est_robot_state_pub_->msg_;
+        est_robot_state.utime = utime;
 
         for (unsigned int i = 0; i < number_of_joint_interfaces_; i++) {
-            est_robot_state_.joint_position[i] = static_cast<float>(joint_state_handles_[i].getPosition());
-            est_robot_state_.joint_velocity[i] = static_cast<float>(joint_state_handles_[i].getVelocity());
-            est_robot_state_.joint_effort[i] = static_cast<float>(joint_state_handles_[i].getEffort());
+            est_robot_state.joint_position[i] = static_cast<float>(joint_state_handles_[i].getPosition());
+            est_robot_state.joint_velocity[i] = static_cast<float>(joint_state_handles_[i].getVelocity());
+            est_robot_state.joint_effort[i] = static_cast<float>(joint_state_handles_[i].getEffort());
         }
 
         // leftFootSixAxis
         hardware_interface::ForceTorqueSensorHandle &l_foot_force_torque = force_torque_handles_["leftFootSixAxis"];
-        est_robot_state_.force_torque.l_foot_force_z = static_cast<float>(l_foot_force_torque.getForce()[2]);
-        est_robot_state_.force_torque.l_foot_torque_x = static_cast<float>(l_foot_force_torque.getTorque()[0]);
-        est_robot_state_.force_torque.l_foot_torque_y = static_cast<float>(l_foot_force_torque.getTorque()[1]);
+        est_robot_state.force_torque.l_foot_force_z = static_cast<float>(l_foot_force_torque.getForce()[2]);
+        est_robot_state.force_torque.l_foot_torque_x = static_cast<float>(l_foot_force_torque.getTorque()[0]);
+        est_robot_state.force_torque.l_foot_torque_y = static_cast<float>(l_foot_force_torque.getTorque()[1]);
 
         // rightFootSixAxis
         hardware_interface::ForceTorqueSensorHandle &r_foot_force_torque = force_torque_handles_["rightFootSixAxis"];
-        est_robot_state_.force_torque.r_foot_force_z = static_cast<float>(r_foot_force_torque.getForce()[2]);
-        est_robot_state_.force_torque.r_foot_torque_x = static_cast<float>(r_foot_force_torque.getTorque()[0]);
-        est_robot_state_.force_torque.r_foot_torque_y = static_cast<float>(r_foot_force_torque.getTorque()[1]);
+        est_robot_state.force_torque.r_foot_force_z = static_cast<float>(r_foot_force_torque.getForce()[2]);
+        est_robot_state.force_torque.r_foot_torque_x = static_cast<float>(r_foot_force_torque.getTorque()[0]);
+        est_robot_state.force_torque.r_foot_torque_y = static_cast<float>(r_foot_force_torque.getTorque()[1]);
 
-        lcm_->publish("EST_ROBOT_STATE", &est_robot_state_);
+        est_robot_state_pub_->unlockAndPublish();
     }
 
     void JointStatePublisher::publishCoreRobotState(int64_t utime) {
-        core_robot_state_.utime = utime;
+        if (compact_core_robot_state_pub_) {
+            if (!compact_core_robot_state_pub_->trylock())
+                return;
+
+            joint_state_compact_t &compact_state = compact_core_robot_state_pub_->msg();
+            for (unsigned int i = 0; i < number_of_joint_interfaces_; i++) {
+                compact_state.joint_position[i] = static_cast<float>(joint_state_handles_[i].getPosition());
+                compact_state.joint_velocity[i] = static_cast<float>(joint_state_handles_[i].getVelocity());
+                compact_state.joint_effort[i] = static_cast<float>(joint_state_handles_[i].getEffort());
+            }
+
+            compact_core_robot_state_pub_->unlockAndPublish(utime);
+            return;
+        }
+
+        if (!core_robot_state_pub_->trylock())
+            return;
+
+        bot_core::joint_state_t &core_robot_state = core_robot_state_pub_->msg_;
+        core_robot_state.utime = utime;
 
         for (unsigned int i = 0; i < number_of_joint_interfaces_; i++) {
-            core_robot_state_.joint_position[i] = static_cast<float>(joint_state_handles_[i].getPosition());
-            core_robot_state_.joint_velocity[i] = static_cast<float>(joint_state_handles_[i].getVelocity());
-            core_robot_state_.joint_effort[i] = static_cast<float>(joint_state_handles_[i].getEffort());
+            core_robot_state.joint_position[i] = static_cast<float>(joint_state_handles_[i].getPosition());
+            core_robot_state.joint_velocity[i] = static_cast<float>(joint_state_handles_[i].getVelocity());
+            core_robot_state.joint_effort[i] = static_cast<float>(joint_state_handles_[i].getEffort());
         }
 
-        lcm_->publish(core_robot_state_channel_.c_str(), &core_robot_state_);
+        core_robot_state_pub_->unlockAndPublish();
     }
 
     void JointStatePublisher::publishIMUReadings(int64_t utime) {
-        for (auto it = imu_sensor_handles_.begin(); it != imu_sensor_handles_.end(); it++) {
-            bot_core::ins_t lcm_imu_msg;
-            std::ostringstream imu_channel;
-            imu_channel << "IMU_" << it->first;
+        unsigned int imu_index = 0;
+        for (auto it = imu_sensor_handles_.begin(); it != imu_sensor_handles_.end(); it++, imu_index++) {
+            if (!schedule_->due(imu_schedules_[imu_index]))
+                continue;
+            RealtimeLCMPublisher<bot_core::ins_t> &imu_pub = *imu_pubs_[imu_index];
+            if (!imu_pub.trylock())
+                continue;
+
+            bot_core::ins_t &lcm_imu_msg = imu_pub.msg_;
             lcm_imu_msg.utime = utime;
 
             lcm_imu_msg.quat[0] = it->second.getOrientation()[0];
@@ -288,23 +496,16 @@ namespace valkyrie_translator {
             lcm_imu_msg.accel[1] = it->second.getLinearAcceleration()[1];
             lcm_imu_msg.accel[2] = it->second.getLinearAcceleration()[2];
 
-            lcm_imu_msg.mag[0] = 0.0;
-            lcm_imu_msg.mag[1] = 0.0;
-            lcm_imu_msg.mag[2] = 0.0;
-
-            lcm_imu_msg.pressure = 0.0;
-            lcm_imu_msg.rel_alt = 0.0;
-
-            lcm_->publish(imu_channel.str(), &lcm_imu_msg);
+            imu_pub.unlockAndPublish();
         }
     }
 
     void JointStatePublisher::publishForceTorqueReadings(int64_t utime) {
-        bot_core::six_axis_force_torque_array_t lcm_ft_array_msg;
+        if (!force_torque_pub_->trylock())
+            return;
+
+        bot_core::six_axis_force_torque_array_t &lcm_ft_array_msg = force_torque_pub_->msg_;
         lcm_ft_array_msg.utime = utime;
-        lcm_ft_array_msg.num_sensors = 2;
-        lcm_ft_array_msg.names.resize(2);
-        lcm_ft_array_msg.sensors.resize(2);
 
         // l_foot
         lcm_ft_array_msg.sensors[0].utime = utime;
@@ -314,7 +515,6 @@ namespace valkyrie_translator {
         lcm_ft_array_msg.sensors[0].moment[0] = force_torque_handles_["leftFootSixAxis"].getTorque()[0];
         lcm_ft_array_msg.sensors[0].moment[1] = force_torque_handles_["leftFootSixAxis"].getTorque()[1];
         lcm_ft_array_msg.sensors[0].moment[2] = force_torque_handles_["leftFootSixAxis"].getTorque()[2];
-        lcm_ft_array_msg.names[0] = "l_foot";
 
         // r_foot
         lcm_ft_array_msg.sensors[1].utime = utime;
@@ -324,10 +524,70 @@ namespace valkyrie_translator {
         lcm_ft_array_msg.sensors[1].moment[0] = force_torque_handles_["rightFootSixAxis"].getTorque()[0];
         lcm_ft_array_msg.sensors[1].moment[1] = force_torque_handles_["rightFootSixAxis"].getTorque()[1];
         lcm_ft_array_msg.sensors[1].moment[2] = force_torque_handles_["rightFootSixAxis"].getTorque()[2];
-        lcm_ft_array_msg.names[1] = "r_foot";
 
+        force_torque_pub_->unlockAndPublish();
+    }
+
+    void JointStatePublisher::publishAggregatedState(int64_t utime, uint64_t tick) {
+        if (!aggregated_state_pub_->trylock())
+            return;
+
+        robot_state_bundle_t &bundle = aggregated_state_pub_->msg_;
+        bundle.utime = utime;
+        bundle.tick = static_cast<int64_t>(tick);
+
+        for (unsigned int i = 0; i < number_of_joint_interfaces_; i++) {
+            bundle.joint_position[i] = static_cast<float>(joint_state_handles_[i].getPosition());
+            bundle.joint_velocity[i] = static_cast<float>(joint_state_handles_[i].getVelocity());
+            bundle.joint_effort[i] = static_cast<float>(joint_state_handles_[i].getEffort());
+        }
+
+        unsigned int imu_index = 0;
+        for (auto it = imu_sensor_handles_.begin(); it != imu_sensor_handles_.end(); it++, imu_index++) {
+            std::copy(it->second.getOrientation(), it->second.getOrientation() + 4,
+                      bundle.imu_orientation[imu_index].begin());
+            std::copy(it->second.getAngularVelocity(), it->second.getAngularVelocity() + 3,
+                      bundle.imu_angular_velocity[imu_index].begin());
+            std::copy(it->second.getLinearAcceleration(), it->second.getLinearAcceleration() + 3,
+                      bundle.imu_linear_acceleration[imu_index].begin());
+        }
+
+        unsigned int force_torque_index = 0;
+        for (auto it = force_torque_handles_.begin(); it != force_torque_handles_.end(); it++, force_torque_index++) {
+            std::copy(it->second.getForce(), it->second.getForce() + 3, bundle.force[force_torque_index].begin());
+            std::copy(it->second.getTorque(), it->second.getTorque() + 3, bundle.torque[force_torque_index].begin());
+        }
+
+        aggregated_state_pub_->unlockAndPublish();
+        aggregated_state_schema_->announce(utime);
+    }
+
+    void JointStatePublisher::writeSharedState(int64_t utime) {
+        shared_state_->beginWrite(utime);
+
+        double *position = shared_state_->jointPosition();
+        double *velocity = shared_state_->jointVelocity();
+        double *effort = shared_state_->jointEffort();
+        for (unsigned int i = 0; i < number_of_joint_interfaces_; i++) {
+            position[i] = joint_state_handles_[i].getPosition();
+            velocity[i] = joint_state_handles_[i].getVelocity();
+            effort[i] = joint_state_handles_[i].getEffort();
+        }
+
+        shared_imu_state *imu = shared_state_->imu();
+        for (auto it = imu_sensor_handles_.begin(); it != imu_sensor_handles_.end(); it++, imu++) {
+            std::copy(it->second.getOrientation(), it->second.getOrientation() + 4, imu->orientation);
+            std::copy(it->second.getAngularVelocity(), it->second.getAngularVelocity() + 3, imu->angular_velocity);
+            std::copy(it->second.getLinearAcceleration(), it->second.getLinearAcceleration() + 3, imu->linear_acceleration);
+        }
+
+        shared_force_torque_state *force_torque = shared_state_->forceTorque();
+        for (auto it = force_torque_handles_.begin(); it != force_torque_handles_.end(); it++, force_torque++) {
+            std::copy(it->second.getForce(), it->second.getForce() + 3, force_torque->force);
+            std::copy(it->second.getTorque(), it->second.getTorque() + 3, force_torque->torque);
+        }
 
-        lcm_->publish("FORCE_TORQUE", &lcm_ft_array_msg); 
+        shared_state_->endWrite();
     }
 
     void JointStatePublisher::stopping(const ros::Time &time) { }
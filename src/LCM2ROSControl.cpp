@@ -23,6 +23,17 @@ inline double clamp(double x, double lower, double upper) {
 
 namespace valkyrie_translator
 {
+  // Event codes for the realtime logger
+  enum
+  {
+    LOG_EFFORT_NULLED,
+    LOG_EFFORT_SCALED,
+    LOG_EFFORT_RATE_LIMITED,
+    LOG_EFFORT_HARD_CUT,
+    LOG_POSITION_CLAMPED,
+    LOG_COMMAND_SCHEMA_MISMATCH
+  };
+
  LCM2ROSControl::LCM2ROSControl()
  {}
 
@@ -43,6 +54,12 @@ namespace valkyrie_translator
     ROS_WARN("Could not read desired setting for publishing CORE_ROBOT_STATE, defaulting to true");
     publishCoreRobotState = true;
   }
+  if (!controller_nh.getParam("compact_core_robot_state", compactCoreRobotState)) {
+    compactCoreRobotState = false;
+  }
+  if (!controller_nh.getParam("compact_commands", compactCommands)) {
+    compactCommands = false;
+  }
   if (!controller_nh.getParam("publish_est_robot_state", publish_est_robot_state)) {
     ROS_WARN("Could not read desired setting for publishing EST_ROBOT_STATE, defaulting to false");
     publish_est_robot_state = false;
@@ -51,15 +68,23 @@ namespace valkyrie_translator
     ROS_WARN("Could not read desired setting for applying actual commands to the robot, defaulting to false");
     applyCommands = false;
   }
+  if (!controller_nh.getParam("lcm_receive_thread", useReceiveThread)) {
+    ROS_WARN("Could not read desired setting for receiving LCM on a separate thread, defaulting to false");
+    useReceiveThread = false;
+  }
 
-        // setup LCM (todo: move to constructor? how to propagate an error then?)
-  lcm_ = boost::shared_ptr<lcm::LCM>(new lcm::LCM);
-  if (!lcm_->good())
-  {
-    std::cerr << "ERROR: lcm is not good()" << std::endl;
+        // setup LCM, shared with the other translator controllers in this process
+  hub_ = LCMTransportHub::acquire();
+  if (!hub_)
     return false;
-  }
-  handler_ = std::shared_ptr<LCM2ROSControl_LCMHandler>(new LCM2ROSControl_LCMHandler(*this));
+  lcm_ = hub_->lcm();
+
+  timing_ = ControllerTiming::fromParameters("LCM2ROSControl", lcm_, controller_nh);
+
+  std::string latency_channel = "VAL_COMMAND_LATENCY";
+  controller_nh.getParam("command_latency_channel", latency_channel);
+  if (!latency_channel.empty())
+    latencyTracker.reset(new CommandLatencyTracker(lcm_, latency_channel));
 
         // Check which joints we have been assigned to
         // If we have joints assigned to just us, claim those, otherwise claim all
@@ -102,23 +127,12 @@ namespace valkyrie_translator
       continue;
 
     try {
-      effortJointHandles[effortNames[i]] = effort_hw->getHandle(effortNames[i]);
-      latest_commands[effortNames[i]] = joint_command();
-      latest_commands[effortNames[i]].position = 0.0;
-      latest_commands[effortNames[i]].velocity = 0.0;
-      latest_commands[effortNames[i]].effort = 0.0;
-      latest_commands[effortNames[i]].k_q_p = 0.0;
-      latest_commands[effortNames[i]].k_q_i = 0.0;
-      latest_commands[effortNames[i]].k_qd_p = 0.0;
-      latest_commands[effortNames[i]].k_f_p = 0.0;
-      latest_commands[effortNames[i]].ff_qd = 0.0;
-      latest_commands[effortNames[i]].ff_qd_d = 0.0;
-      latest_commands[effortNames[i]].ff_f_d = 0.0;
-      latest_commands[effortNames[i]].ff_const = 0.0;
+      addJointSlot(effortNames[i], effort_hw->getHandle(effortNames[i]));
     } catch (const hardware_interface::HardwareInterfaceException& e) {
       ROS_ERROR_STREAM("Could not retrieve handle for " << effortNames[i] << ": " << e.what());
     }
   }
+  numberOfEffortJoints = joints.size();
 
   auto effort_hw_claims = effort_hw->getClaims();
   claimed_resources.insert(effort_hw_claims.begin(), effort_hw_claims.end());
@@ -141,19 +155,7 @@ namespace valkyrie_translator
       continue;
 
     try {
-      positionJointHandles[positionNames[i]] = position_hw->getHandle(positionNames[i]);
-      latest_commands[positionNames[i]] = joint_command();
-      latest_commands[positionNames[i]].position = 0.0;
-      latest_commands[positionNames[i]].velocity = 0.0;
-      latest_commands[positionNames[i]].effort = 0.0;
-      latest_commands[positionNames[i]].k_q_p = 0.0;
-      latest_commands[positionNames[i]].k_q_i = 0.0;
-      latest_commands[positionNames[i]].k_qd_p = 0.0;
-      latest_commands[positionNames[i]].k_f_p = 0.0;
-      latest_commands[positionNames[i]].ff_qd = 0.0;
-      latest_commands[positionNames[i]].ff_qd_d = 0.0;
-      latest_commands[positionNames[i]].ff_f_d = 0.0;
-      latest_commands[positionNames[i]].ff_const = 0.0;
+      addJointSlot(positionNames[i], position_hw->getHandle(positionNames[i]));
     } catch (const hardware_interface::HardwareInterfaceException& e) {
       ROS_ERROR_STREAM("Could not retrieve handle for " << positionNames[i] << ": " << e.what());
     }
@@ -214,6 +216,77 @@ namespace valkyrie_translator
   claimed_resources.insert(forceTorque_hw_claims.begin(), forceTorque_hw_claims.end());
   forceTorque_hw->clearClaims();
 
+        // preallocate the command mailbox now that the joint table is final,
+        // then start listening for commands
+  joint_command_set initialCommands;
+  initialCommands.assign(joints.size());
+  commandMailbox.reset(initialCommands);
+  measuredPosition.assign(numberOfEffortJoints, 0.0);
+  measuredVelocity.assign(numberOfEffortJoints, 0.0);
+  measuredEffort.assign(numberOfEffortJoints, 0.0);
+  commandedEffort.assign(numberOfEffortJoints, 0.0);
+  limitedEffort.assign(numberOfEffortJoints, 0.0);
+  effortLimitEvents.assign(numberOfEffortJoints, 0);
+  effortLimits.min_position.resize(numberOfEffortJoints);
+  effortLimits.max_position.resize(numberOfEffortJoints);
+  effortLimits.max_effort.resize(numberOfEffortJoints);
+  for (size_t i = 0; i < numberOfEffortJoints; i++)
+  {
+    effortLimits.min_position[i] = joints[i].limits.min_position;
+    effortLimits.max_position[i] = joints[i].limits.max_position;
+    effortLimits.max_effort[i] = joints[i].limits.max_effort;
+  }
+  initStateMessages();
+
+  std::string sharedCommandName;
+  if (controller_nh.getParam("shared_command_name", sharedCommandName) && !sharedCommandName.empty()) {
+    int capacity = 16;
+    controller_nh.getParam("shared_command_capacity", capacity);
+    int mode = 0660;
+    controller_nh.getParam("shared_command_mode", mode);
+    std::vector<std::string> slotNames;
+    for (size_t i = 0; i < joints.size(); i++)
+      slotNames.push_back(joints[i].name);
+    sharedCommandSet.assign(joints.size());
+    sharedCommands.reset(new SharedCommandReceiver);
+    if (sharedCommands->open(sharedCommandName, slotNames, std::max(capacity, 1), static_cast<mode_t>(mode & 0777)))
+      ROS_INFO_STREAM("Accepting commands through shared memory " << sharedCommandName);
+    else
+      sharedCommands.reset();
+  }
+
+  std::string sharedStateName;
+  if (controller_nh.getParam("shared_state_name", sharedStateName) && !sharedStateName.empty()) {
+    std::vector<std::string> slotNames, imuNames, forceTorqueNames;
+    for (size_t i = 0; i < joints.size(); i++)
+      slotNames.push_back(joints[i].name);
+    for (auto it = imuSensorHandles.begin(); it != imuSensorHandles.end(); it++)
+      imuNames.push_back(it->first);
+    for (auto it = forceTorqueHandles.begin(); it != forceTorqueHandles.end(); it++)
+      forceTorqueNames.push_back(it->first);
+    sharedState.reset(new SharedStateWriter);
+    if (!sharedState->open(sharedStateName, slotNames, imuNames, forceTorqueNames))
+      return false;
+    ROS_INFO_STREAM("Exporting state to shared memory " << sharedStateName);
+  }
+
+  std::vector<std::string> jointNames;
+  for (size_t i = 0; i < joints.size(); i++)
+    jointNames.push_back(joints[i].name);
+  jointNames.push_back("ROBOT_COMMAND_COMPACT");  // index joints.size(), for events about the channel itself
+  logger_.reset(new RealtimeLogger(jointNames));
+  logger_->registerEvent(LOG_EFFORT_NULLED, "Dangerous command modified: joint %s force %f nulled due to joint out of range %f");
+  logger_->registerEvent(LOG_EFFORT_SCALED, "Dangerous command modified: joint %s force %f scaled due to joint out of range %f");
+  logger_->registerEvent(LOG_EFFORT_RATE_LIMITED, "Dangerous command modified: joint %s force %f out of range of current force %f");
+  logger_->registerEvent(LOG_EFFORT_HARD_CUT, "Dangerous latest_commands for joint %s: somehow commanding %f");
+  logger_->registerEvent(LOG_POSITION_CLAMPED, "Dangerous command modified: joint %s position %f out of joint limits");
+  logger_->registerEvent(LOG_COMMAND_SCHEMA_MISMATCH, "%s: rejected a message built for a different joint table (hash %lld, %.0f so far)");
+  logger_->start();
+  handler_ = std::shared_ptr<LCM2ROSControl_LCMHandler>(new LCM2ROSControl_LCMHandler(*this, hub_));
+        // the thread is created and joined here and by the handler's destructor, never on the realtime thread
+  if (useReceiveThread)
+    handler_->startReceiveThread();
+
         // success
   state_ = INITIALIZED;
   ROS_INFO_STREAM("LCM2ROSCONTROL ON with " << claimed_resources.size() << " claimed resources:" << std::endl
@@ -224,56 +297,73 @@ namespace valkyrie_translator
   return true;
 }
 
-void LCM2ROSControl::starting(const ros::Time& time)
+void LCM2ROSControl::addJointSlot(const std::string& name, const hardware_interface::JointHandle& handle)
 {
-  last_update = time;
+  joint_slot slot;
+  slot.name = name;
+  slot.handle = handle;
+
+  auto limits_search = joint_limits.find(name);
+  if (limits_search == joint_limits.end()){
+    // defaults
+    slot.limits.min_position = DEFAULT_MIN_POSITION;
+    slot.limits.max_position = DEFAULT_MAX_POSITION;
+    slot.limits.max_effort = DEFAULT_MAX_EFFORT;
+  } else {
+    slot.limits = limits_search->second;
+  }
+
+  if (jointSlotIndex.find(name) != jointSlotIndex.end())
+    ROS_WARN_STREAM("Joint " << name << " is exposed by more than one interface, commands will only reach the last one");
+  jointSlotIndex[name] = joints.size();
+  joints.push_back(slot);
 }
 
-void LCM2ROSControl::update(const ros::Time& time, const ros::Duration& period)
+void LCM2ROSControl::initStateMessages()
 {
-  handler_->update();
-  lcm_->handleTimeout(0);
-
-  double dt = (time - last_update).toSec();
-  last_update = time;
-  int64_t utime = time.toSec() * 1000000.;
-
-  size_t numberOfJointInterfaces = effortJointHandles.size() + positionJointHandles.size();
+  size_t numberOfJointInterfaces = joints.size();
 
       // CORE_ROBOT_STATE
       // push out the joint states for all joints we see advertised
-      // and also the commanded torques, for reference
-  bot_core::joint_state_t lcm_pose_msg;
-  lcm_pose_msg.utime = utime;
+  coreRobotStatePub.reset(new RealtimeLCMPublisher<bot_core::joint_state_t>(lcm_, "CORE_ROBOT_STATE"));
+  bot_core::joint_state_t& lcm_pose_msg = coreRobotStatePub->msg_;
+  lcm_pose_msg.utime = 0;
   lcm_pose_msg.num_joints = numberOfJointInterfaces;
   lcm_pose_msg.joint_name.assign(numberOfJointInterfaces, "");
   lcm_pose_msg.joint_position.assign(numberOfJointInterfaces, 0.);
   lcm_pose_msg.joint_velocity.assign(numberOfJointInterfaces, 0.);
   lcm_pose_msg.joint_effort.assign(numberOfJointInterfaces, 0.);
 
+      // CORE_ROBOT_STATE_COMPACT / CORE_ROBOT_STATE_SCHEMA
+      // the same without joint names, if requested
+  if (compactCoreRobotState) {
+    std::vector<std::string> slotNames;
+    for (size_t i = 0; i < joints.size(); i++)
+      slotNames.push_back(joints[i].name);
+    compactCoreRobotStatePub.reset(new CompactJointStatePublisher(lcm_, "CORE_ROBOT_STATE", slotNames));
+  }
+
       // VAL_COMMAND_FEEDBACK
-  bot_core::joint_state_t lcm_commanded_msg;
-  lcm_commanded_msg.utime = utime;
-  lcm_commanded_msg.num_joints = numberOfJointInterfaces;
-  lcm_commanded_msg.joint_name.assign(numberOfJointInterfaces, "");
-  lcm_commanded_msg.joint_position.assign(numberOfJointInterfaces, 0.);
-  lcm_commanded_msg.joint_velocity.assign(numberOfJointInterfaces, 0.);
-  lcm_commanded_msg.joint_effort.assign(numberOfJointInterfaces, 0.);
+      // the commands as we received them, for reference
+  commandFeedbackPub.reset(new RealtimeLCMPublisher<bot_core::joint_state_t>(lcm_, "VAL_COMMAND_FEEDBACK"));
+  commandFeedbackPub->msg_ = lcm_pose_msg;
 
       // VAL_COMMAND_FEEDBACK_TORQUE
       // TODO: add the position elements here, even though they aren't torques
-  bot_core::joint_angles_t lcm_torque_msg;
+  commandFeedbackTorquePub.reset(new RealtimeLCMPublisher<bot_core::joint_angles_t>(lcm_, "VAL_COMMAND_FEEDBACK_TORQUE"));
+  bot_core::joint_angles_t& lcm_torque_msg = commandFeedbackTorquePub->msg_;
   lcm_torque_msg.robot_name = "val!";
-  lcm_torque_msg.utime = utime;
-  lcm_torque_msg.num_joints = effortJointHandles.size();
-  lcm_torque_msg.joint_name.assign(effortJointHandles.size(), "");
-  lcm_torque_msg.joint_position.assign(effortJointHandles.size(), 0.);
+  lcm_torque_msg.utime = 0;
+  lcm_torque_msg.num_joints = numberOfEffortJoints;
+  lcm_torque_msg.joint_name.assign(numberOfEffortJoints, "");
+  lcm_torque_msg.joint_position.assign(numberOfEffortJoints, 0.);
 
       // EST_ROBOT_STATE
       // need to decide what message we're really using for state. for now,
       // assembling this to make director happy
-  bot_core::robot_state_t lcm_state_msg;
-  lcm_state_msg.utime = utime;
+  estRobotStatePub.reset(new RealtimeLCMPublisher<bot_core::robot_state_t>(lcm_, "EST_ROBOT_STATE"));
+  bot_core::robot_state_t& lcm_state_msg = estRobotStatePub->msg_;
+  lcm_state_msg.utime = 0;
   lcm_state_msg.num_joints = numberOfJointInterfaces;
   lcm_state_msg.joint_name.assign(numberOfJointInterfaces, "");
   lcm_state_msg.joint_position.assign(numberOfJointInterfaces, 0.);
@@ -292,186 +382,405 @@ void LCM2ROSControl::update(const ros::Time& time, const ros::Duration& period)
   lcm_state_msg.twist.angular_velocity.x = 0.0;
   lcm_state_msg.twist.angular_velocity.y = 0.0;
   lcm_state_msg.twist.angular_velocity.z = 0.0;
+  lcm_state_msg.force_torque = bot_core::force_torque_t();
 
+      // joint names never change after init, so fill them in once
+  for (size_t i = 0; i < joints.size(); i++)
+  {
+    lcm_pose_msg.joint_name[i] = joints[i].name;
+    commandFeedbackPub->msg_.joint_name[i] = joints[i].name;
+    lcm_state_msg.joint_name[i] = joints[i].name;
+    if (i < numberOfEffortJoints)
+      lcm_torque_msg.joint_name[i] = joints[i].name;
+  }
+}
 
-      // Iterate over all effort-controlled joints
-  size_t effortJointIndex = 0;
-  for(auto iter = effortJointHandles.begin(); iter != effortJointHandles.end(); iter++)
+void LCM2ROSControl::reportEffortLimitEvents()
+{
+  // only queues the events, formatting happens on the logger thread.
+  // clamping to max_effort is expected during normal operation and not reported
+  for (size_t i = 0; i < numberOfEffortJoints; i++)
   {
-          // see drc_joint_command_t.lcm for explanation of gains and
-          // force calculation.
-    double q = iter->second.getPosition();
-    double qd = iter->second.getVelocity();
-    double f = iter->second.getEffort();
-
-    joint_command& command = latest_commands[iter->first];
-    double command_effort =
-    command.k_q_p * ( command.position - q ) +
-    command.k_q_i * ( command.position - q ) * dt +
-    command.k_qd_p * ( command.velocity - qd) +
-    command.k_f_p * ( command.effort - f) +
-    command.ff_qd * ( qd ) +
-    command.ff_qd_d * ( command.velocity ) +
-    command.ff_f_d * ( command.effort ) +
-    command.ff_const;
-
-
-    auto limits_search = joint_limits.find(iter->first);
-    joint_limits_interface::JointLimits limits;
-    if (limits_search == joint_limits.end()){
-            // defaults
-      limits.min_position = DEFAULT_MIN_POSITION;
-      limits.max_position = DEFAULT_MAX_POSITION;
-      limits.max_effort = DEFAULT_MAX_EFFORT;
-    } else {
-      limits = limits_search->second;
-    }
+    uint8_t events = effortLimitEvents[i];
+    if (!(events & ~EFFORT_CLAMPED))
+      continue;
 
-          // bound the force within our max force limits
-    command_effort = clamp(command_effort, -limits.max_effort, limits.max_effort);
+    if (events & EFFORT_NULLED_OUT_OF_RANGE)
+      logger_->log(LOG_EFFORT_NULLED, i, commandedEffort[i], measuredPosition[i]);
+    if (events & EFFORT_SCALED_NEAR_LIMIT)
+      logger_->log(LOG_EFFORT_SCALED, i, commandedEffort[i], measuredPosition[i]);
+    if (events & EFFORT_RATE_LIMITED)
+      logger_->log(LOG_EFFORT_RATE_LIMITED, i, commandedEffort[i], measuredEffort[i]);
+    if (events & EFFORT_HARD_CUT)
+      logger_->log(LOG_EFFORT_HARD_CUT, i, commandedEffort[i]);
+  }
+}
 
-           // and ramp down the force to 0 in the 0.1 radians after the joint limit
-    double err_beyond_bound = fmax(q - limits.max_position, limits.min_position - q);
-    if (err_beyond_bound >= FORCE_CONTROL_ALLOWABLE_POSITION_ERR_BOUND){
-      ROS_INFO("Dangerous command modified: joint %s force %f nulled due to joint out of range %f\n", iter->first.c_str(), command_effort, q);
-      command_effort = 0.0;
+void LCM2ROSControl::writeSharedState(int64_t utime)
+{
+  sharedState->beginWrite(utime);
+
+  double* position = sharedState->jointPosition();
+  double* velocity = sharedState->jointVelocity();
+  double* effort = sharedState->jointEffort();
+  std::copy(measuredPosition.begin(), measuredPosition.end(), position);
+  std::copy(measuredVelocity.begin(), measuredVelocity.end(), velocity);
+  std::copy(measuredEffort.begin(), measuredEffort.end(), effort);
+  for (size_t i = numberOfEffortJoints; i < joints.size(); i++)
+  {
+    position[i] = joints[i].handle.getPosition();
+    velocity[i] = joints[i].handle.getVelocity();
+    effort[i] = joints[i].handle.getEffort();
+  }
+
+  shared_imu_state* imu = sharedState->imu();
+  for (auto it = imuSensorHandles.begin(); it != imuSensorHandles.end(); it++, imu++)
+  {
+    std::copy(it->second.getOrientation(), it->second.getOrientation() + 4, imu->orientation);
+    std::copy(it->second.getAngularVelocity(), it->second.getAngularVelocity() + 3, imu->angular_velocity);
+    std::copy(it->second.getLinearAcceleration(), it->second.getLinearAcceleration() + 3, imu->linear_acceleration);
+  }
+
+  shared_force_torque_state* forceTorque = sharedState->forceTorque();
+  for (auto it = forceTorqueHandles.begin(); it != forceTorqueHandles.end(); it++, forceTorque++)
+  {
+    std::copy(it->second.getForce(), it->second.getForce() + 3, forceTorque->force);
+    std::copy(it->second.getTorque(), it->second.getTorque() + 3, forceTorque->torque);
+  }
+
+  sharedState->endWrite();
+}
+
+void LCM2ROSControl::starting(const ros::Time& time)
+{
+  last_update = time;
+}
+
+void LCM2ROSControl::update(const ros::Time& time, const ros::Duration& period)
+{
+  if (timing_)
+    timing_->beginCycle(time);
+
+  if (!useReceiveThread)
+    handler_->update(time);
+  if (compactCommands) {
+    handler_->announceSchema(time.toNSec() / 1000);
+    uint32_t rejected = handler_->rejectedCompactCommands();
+    if (rejected != reportedCompactRejections) {
+      logger_->logInteger(LOG_COMMAND_SCHEMA_MISMATCH, joints.size(), handler_->lastRejectedSchemaHash(), rejected);
+      reportedCompactRejections = rejected;
     }
-    else if (err_beyond_bound >= 0){              
-     ROS_INFO("Dangerous command modified: joint %s force %f scaled due to joint out of range %f\n", iter->first.c_str(), command_effort, q);
-            command_effort *= (FORCE_CONTROL_ALLOWABLE_POSITION_ERR_BOUND - err_beyond_bound) / FORCE_CONTROL_ALLOWABLE_POSITION_ERR_BOUND; // start at no scaling, scale down to 0 at ERR_BOUND
-          }
+  }
+
+      // pick up the newest complete command set, if any arrived
+  const bool sharedCommandsWereActive = sharedCommandsActive;
+  bool newCommand = commandMailbox.consume();
+  if (newCommand)
+    sharedCommandsActive = false;
+
+      // commands from the shared memory ring are applied right here, with the
+      // same semantics as jointCommandHandler
+  if (sharedCommands) {
+      // on switching over, joints the ring does not mention keep their last ROBOT_COMMAND values
+    if (!sharedCommandsActive && sharedCommands->pending())
+      static_cast<joint_command_arrays&>(sharedCommandSet) = commandMailbox.readBuffer();
+    size_t received = sharedCommands->receive(sharedCommandSet, sharedCommandSet.source_utime);
+    if (received > 0) {
+      sharedCommandSet.receive_utime = CommandLatencyTracker::wallUtime();
+      sharedCommandSet.sequence += received;
+      sharedCommandsActive = true;
+      newCommand = true;
+    }
+  }
+  const joint_command_set& commands = sharedCommandsActive ? sharedCommandSet : commandMailbox.readBuffer();
+  if (latencyTracker && sharedCommandsActive != sharedCommandsWereActive)
+    latencyTracker->sourceChanged();
+  if (timing_)
+    timing_->mark(ControllerTiming::PHASE_INBOUND);
 
-          // finally, bound to force to be within epsilon of the currently applied force
-          if (fabs(command_effort - f) >= FORCE_CONTROL_MAX_CHANGE)
-            ROS_INFO("Dangerous command modified: joint %s force %f out of range of current force %f\n", iter->first.c_str(), command_effort, f);
+  double dt = (time - last_update).toSec();
+  last_update = time;
+  int64_t utime = time.toSec() * 1000000.;
 
-          if (command_effort > f)
-            command_effort = fmin(f + FORCE_CONTROL_MAX_CHANGE, command_effort);
-          else
-            command_effort = fmax(f - FORCE_CONTROL_MAX_CHANGE, command_effort);
+      // only fill in the state messages whose previous publish has gone out;
+      // the rest are skipped for this tick
+  bool publishPose = publishCoreRobotState && !compactCoreRobotState && coreRobotStatePub->trylock();
+  bool publishCompactPose = publishCoreRobotState && compactCoreRobotState && compactCoreRobotStatePub->trylock();
+  bool publishState = publish_est_robot_state && estRobotStatePub->trylock();
+  bool publishCommanded = commandFeedbackPub->trylock();
+  bool publishTorque = commandFeedbackTorquePub->trylock();
+
+  bot_core::joint_state_t& lcm_pose_msg = coreRobotStatePub->msg_;
+  bot_core::robot_state_t& lcm_state_msg = estRobotStatePub->msg_;
+  bot_core::joint_state_t& lcm_commanded_msg = commandFeedbackPub->msg_;
+  bot_core::joint_angles_t& lcm_torque_msg = commandFeedbackTorquePub->msg_;
+  joint_state_compact_t* lcm_compact_pose_msg = compactCoreRobotState ? &compactCoreRobotStatePub->msg() : nullptr;
+
+      // Gather measurements of all effort-controlled joints, then evaluate the
+      // control law for all of them at once.
+      // see drc_joint_command_t.lcm for explanation of gains and
+      // force calculation.
+  for (size_t i = 0; i < numberOfEffortJoints; i++)
+  {
+    measuredPosition[i] = joints[i].handle.getPosition();
+    measuredVelocity[i] = joints[i].handle.getVelocity();
+    measuredEffort[i] = joints[i].handle.getEffort();
+  }
+  computeEffort(commands, measuredPosition.data(), measuredVelocity.data(), measuredEffort.data(),
+                dt, commandedEffort.data(), numberOfEffortJoints);
+
+      // Apply the effort clamp, the ramp-down past the joint limits, the slew
+      // bound relative to the applied force and the hard cut to all joints in
+      // one pass; effortLimitEvents records which of them fired per joint
+  effort_safety_parameters safety;
+  safety.position_err_bound = FORCE_CONTROL_ALLOWABLE_POSITION_ERR_BOUND;
+  safety.max_change = FORCE_CONTROL_MAX_CHANGE;
+  safety.hard_limit = FORCE_CONTROL_HARD_LIMIT;
+  applyEffortLimits(effortLimits, safety, commandedEffort.data(), measuredPosition.data(), measuredEffort.data(),
+                    limitedEffort.data(), effortLimitEvents.data(), numberOfEffortJoints);
+  reportEffortLimitEvents();
+  if (timing_)
+    timing_->mark(ControllerTiming::PHASE_CONTROL);
+
+      // Iterate over all effort-controlled joints
+  for (size_t i = 0; i < numberOfEffortJoints; i++)
+  {
+    double q = measuredPosition[i];
+    double qd = measuredVelocity[i];
+    double f = measuredEffort[i];
 
           // only apply this command to the robot if this flag is set to true
-          if(applyCommands){
-            // apply those forces
-            if (fabs(command_effort) < 1000.){
-              iter->second.setCommand(command_effort);
-            } else {
-              ROS_INFO("Dangerous latest_commands for joint %s: somehow commanding %f\n", iter->first.c_str(), command_effort);
-              iter->second.setCommand(0.0);
-            }
-          }
+          if (applyCommands)
+            joints[i].handle.setCommand(limitedEffort[i]);
 
+          if (publishPose){
+            lcm_pose_msg.joint_position[i] = q;
+            lcm_pose_msg.joint_velocity[i] = qd;
+            lcm_pose_msg.joint_effort[i] = f; // measured!
+          }
 
-          lcm_pose_msg.joint_name[effortJointIndex] = iter->first;
-          lcm_pose_msg.joint_position[effortJointIndex] = q;
-          lcm_pose_msg.joint_velocity[effortJointIndex] = qd;
-          lcm_pose_msg.joint_effort[effortJointIndex] = iter->second.getEffort(); // measured!
+          if (publishCompactPose){
+            lcm_compact_pose_msg->joint_position[i] = q;
+            lcm_compact_pose_msg->joint_velocity[i] = qd;
+            lcm_compact_pose_msg->joint_effort[i] = f; // measured!
+          }
 
-          lcm_state_msg.joint_name[effortJointIndex] = iter->first;
-          lcm_state_msg.joint_position[effortJointIndex] = q;
-          lcm_state_msg.joint_velocity[effortJointIndex] = qd;
-          lcm_state_msg.joint_effort[effortJointIndex] = iter->second.getEffort(); // measured!
+          if (publishState){
+            lcm_state_msg.joint_position[i] = q;
+            lcm_state_msg.joint_velocity[i] = qd;
+            lcm_state_msg.joint_effort[i] = f; // measured!
+          }
 
           // republish to guarantee sync
-          lcm_commanded_msg.joint_name[effortJointIndex] = iter->first;
-          lcm_commanded_msg.joint_position[effortJointIndex] = command.position;
-          lcm_commanded_msg.joint_velocity[effortJointIndex] = command.velocity;
-          lcm_commanded_msg.joint_effort[effortJointIndex] = command.effort;
-
-          lcm_torque_msg.joint_name[effortJointIndex] = iter->first;
-          lcm_torque_msg.joint_position[effortJointIndex] = command_effort;
+          if (publishCommanded){
+            lcm_commanded_msg.joint_position[i] = commands.position[i];
+            lcm_commanded_msg.joint_velocity[i] = commands.velocity[i];
+            lcm_commanded_msg.joint_effort[i] = commands.effort[i];
+          }
 
-          effortJointIndex++;
+          if (publishTorque)
+            lcm_torque_msg.joint_position[i] = limitedEffort[i];
         }
 
       // Iterate over all position-controlled joints
-        size_t positionJointIndex = effortJointIndex;
-        for (auto iter = positionJointHandles.begin(); iter != positionJointHandles.end(); iter++) {
-          double q = iter->second.getPosition();
-          double qd = iter->second.getVelocity();
+        for (size_t i = numberOfEffortJoints; i < joints.size(); i++) {
+          joint_slot& joint = joints[i];
+
+          double q = joint.handle.getPosition();
+          double qd = joint.handle.getVelocity();
 
-          joint_command& command = latest_commands[iter->first];
-          double position_to_go = command.position;
+          double position_to_go = commands.position[i];
 
           // clamp to joint limits
-          auto limits_search = joint_limits.find(iter->first);
-          joint_limits_interface::JointLimits limits;
-          if (limits_search == joint_limits.end()){
-            // defaults
-            limits.min_position = DEFAULT_MIN_POSITION;
-            limits.max_position = DEFAULT_MAX_POSITION;
-            limits.max_effort = DEFAULT_MAX_EFFORT;
-          }
+          const joint_limits_interface::JointLimits& limits = joint.limits;
           if (position_to_go > limits.max_position || position_to_go < limits.min_position)
-            ROS_INFO("Dangerous command modified: joint %s position %f out of joint limits\n", iter->first.c_str(), position_to_go);
+            logger_->log(LOG_POSITION_CLAMPED, i, position_to_go);
 
           position_to_go = clamp(position_to_go, limits.min_position, limits.max_position);
 
           if (applyCommands){
-            iter->second.setCommand(position_to_go);
+            joint.handle.setCommand(position_to_go);
           }
 
-          // TODO: we can't directly iterate like this, better match differently!!
+          if (publishPose){
+            lcm_pose_msg.joint_position[i] = q;
+            lcm_pose_msg.joint_velocity[i] = qd;
+          }
 
-          lcm_pose_msg.joint_name[positionJointIndex] = iter->first;
-          lcm_pose_msg.joint_position[positionJointIndex] = q;
-          lcm_pose_msg.joint_velocity[positionJointIndex] = qd;
+          if (publishCompactPose){
+            lcm_compact_pose_msg->joint_position[i] = q;
+            lcm_compact_pose_msg->joint_velocity[i] = qd;
+          }
 
-          lcm_state_msg.joint_name[positionJointIndex] = iter->first;
-          lcm_state_msg.joint_position[positionJointIndex] = q;
-          lcm_state_msg.joint_velocity[positionJointIndex] = qd;
+          if (publishState){
+            lcm_state_msg.joint_position[i] = q;
+            lcm_state_msg.joint_velocity[i] = qd;
+          }
 
           // republish to guarantee sync
-          lcm_commanded_msg.joint_name[positionJointIndex] = iter->first;
-          lcm_commanded_msg.joint_position[positionJointIndex] = command.position;
-          lcm_commanded_msg.joint_velocity[positionJointIndex] = command.velocity;
-          lcm_commanded_msg.joint_effort[positionJointIndex] = command.effort;
+          if (publishCommanded){
+            lcm_commanded_msg.joint_position[i] = commands.position[i];
+            lcm_commanded_msg.joint_velocity[i] = commands.velocity[i];
+            lcm_commanded_msg.joint_effort[i] = commands.effort[i];
+          }
+        }
+
+        // record how old the command was when it first reached the joints
+        if (newCommand && latencyTracker)
+          latencyTracker->commandApplied(utime, commands.source_utime, commands.receive_utime, commands.sequence);
+        if (timing_)
+          timing_->mark(ControllerTiming::PHASE_COMMAND);
 
-          positionJointIndex++;
+        if (sharedState)
+          writeSharedState(utime);
+
+        if (publishPose){
+          lcm_pose_msg.utime = utime;
+          coreRobotStatePub->unlockAndPublish();
+        }
+        if (publishCompactPose)
+          compactCoreRobotStatePub->unlockAndPublish(utime);
+        if (publishState){
+          lcm_state_msg.utime = utime;
+          estRobotStatePub->unlockAndPublish();
+        }
+        if (publishCommanded){
+          lcm_commanded_msg.utime = utime;
+          commandFeedbackPub->unlockAndPublish();
+        }
+        if (publishTorque){
+          lcm_torque_msg.utime = utime;
+          commandFeedbackTorquePub->unlockAndPublish();
+        }
+        if (timing_){
+          timing_->mark(ControllerTiming::PHASE_PUBLISH);
+          timing_->endCycle();
         }
-      
     }
 
     void LCM2ROSControl::stopping(const ros::Time& time)
     {}
 
-    LCM2ROSControl_LCMHandler::LCM2ROSControl_LCMHandler(LCM2ROSControl& parent) : parent_(parent) {
-      lcm_ = std::shared_ptr<lcm::LCM>(new lcm::LCM);
-      if (!lcm_->good())
-      {
-        std::cerr << "ERROR: handler lcm is not good()" << std::endl;
+    LCM2ROSControl_LCMHandler::LCM2ROSControl_LCMHandler(LCM2ROSControl& parent,
+     const std::shared_ptr<LCMTransportHub>& hub) : parent_(parent), hub_(hub),
+     compact_subscription_(nullptr), rejected_compact_commands_(0), last_rejected_schema_hash_(0), receive_thread_requested_(false) {
+      pending_commands_.assign(parent_.joints.size());
+      command_layout_.reserve(parent_.joints.size());
+      command_layout_names_.reserve(parent_.joints.size());
+      subscription_ = hub_->subscribe("ROBOT_COMMAND", &LCM2ROSControl_LCMHandler::jointCommandHandler, this);
+      if (parent_.compactCommands) {
+        std::vector<std::string> slotNames;
+        for (size_t i = 0; i < parent_.joints.size(); i++)
+          slotNames.push_back(parent_.joints[i].name);
+        command_schema_.reset(new JointSchemaAnnouncer(hub_->lcm(), "ROBOT_COMMAND_SCHEMA", slotNames));
+        compact_subscription_ = hub_->subscribe("ROBOT_COMMAND_COMPACT", &LCM2ROSControl_LCMHandler::compactCommandHandler, this);
       }
-      lcm_->subscribe("ROBOT_COMMAND", &LCM2ROSControl_LCMHandler::jointCommandHandler, this);
     }
-    LCM2ROSControl_LCMHandler::~LCM2ROSControl_LCMHandler() {}
+    LCM2ROSControl_LCMHandler::~LCM2ROSControl_LCMHandler() {
+      stopReceiveThread();
+      hub_->unsubscribe(subscription_);
+      if (compact_subscription_)
+        hub_->unsubscribe(compact_subscription_);
+    }
 
     void LCM2ROSControl_LCMHandler::jointCommandHandler(const lcm::ReceiveBuffer* rbuf, const std::string &channel,
      const bot_core::atlas_command_t* msg) {
       // TODO: zero non-mentioned joints for safety?
 
+      const std::vector<int>& layout = commandLayout(msg->joint_names);
       for (unsigned int i = 0; i < msg->num_joints; ++i) {
-        // ROS_WARN("Joint %s ", msg->joint_names[i].c_str());
-        auto search = parent_.latest_commands.find(msg->joint_names[i]);
-        if (search != parent_.latest_commands.end()) {
-          joint_command& command = parent_.latest_commands[msg->joint_names[i]];
-          command.position = msg->position[i];
-          command.velocity = msg->velocity[i];
-          command.effort = msg->effort[i];
-          command.k_q_p = msg->k_q_p[i];
-          command.k_q_i = msg->k_q_i[i];
-          command.k_qd_p = msg->k_qd_p[i];
-          command.k_f_p = msg->k_f_p[i];
-          command.ff_qd = msg->ff_qd[i];
-          command.ff_qd_d = msg->ff_qd_d[i];
-          command.ff_f_d = msg->ff_f_d[i];
-          command.ff_const = msg->ff_const[i];
-        } else {
-          // ROS_WARN("had no match.");
+        if (layout[i] >= 0) {
+          size_t slot = layout[i];
+          pending_commands_.position[slot] = msg->position[i];
+          pending_commands_.velocity[slot] = msg->velocity[i];
+          pending_commands_.effort[slot] = msg->effort[i];
+          pending_commands_.k_q_p[slot] = msg->k_q_p[i];
+          pending_commands_.k_q_i[slot] = msg->k_q_i[i];
+          pending_commands_.k_qd_p[slot] = msg->k_qd_p[i];
+          pending_commands_.k_f_p[slot] = msg->k_f_p[i];
+          pending_commands_.ff_qd[slot] = msg->ff_qd[i];
+          pending_commands_.ff_qd_d[slot] = msg->ff_qd_d[i];
+          pending_commands_.ff_f_d[slot] = msg->ff_f_d[i];
+          pending_commands_.ff_const[slot] = msg->ff_const[i];
         }
       }
+
+      publishPendingCommands(msg->utime, rbuf->recv_utime);
+    }
+
+    void LCM2ROSControl_LCMHandler::compactCommandHandler(const lcm::ReceiveBuffer* rbuf, const std::string &channel,
+     const joint_command_compact_t* msg) {
+      // slots are only meaningful against the table we announced
+      if (msg->schema_hash != command_schema_->hash()) {
+        last_rejected_schema_hash_ = msg->schema_hash;
+        rejected_compact_commands_++;
+        return;
+      }
+
+      const size_t numSlots = parent_.joints.size();
+      for (int i = 0; i < msg->num_joints; ++i) {
+        size_t slot = static_cast<uint16_t>(msg->slot[i]);
+        if (slot >= numSlots)
+          continue;
+        pending_commands_.position[slot] = msg->position[i];
+        pending_commands_.velocity[slot] = msg->velocity[i];
+        pending_commands_.effort[slot] = msg->effort[i];
+        pending_commands_.k_q_p[slot] = msg->k_q_p[i];
+        pending_commands_.k_q_i[slot] = msg->k_q_i[i];
+        pending_commands_.k_qd_p[slot] = msg->k_qd_p[i];
+        pending_commands_.k_f_p[slot] = msg->k_f_p[i];
+        pending_commands_.ff_qd[slot] = msg->ff_qd[i];
+        pending_commands_.ff_qd_d[slot] = msg->ff_qd_d[i];
+        pending_commands_.ff_f_d[slot] = msg->ff_f_d[i];
+        pending_commands_.ff_const[slot] = msg->ff_const[i];
+      }
+
+      publishPendingCommands(msg->utime, rbuf->recv_utime);
+    }
+
+    const std::vector<int>& LCM2ROSControl_LCMHandler::commandLayout(const std::vector<std::string>& joint_names) {
+      // senders almost always repeat the same joint order, so the name lookups
+      // only run when the layout changes; comparing the names themselves stops
+      // at the first difference and cannot mistake one layout for another
+      if (joint_names == command_layout_names_)
+        return command_layout_;
+
+      command_layout_.resize(joint_names.size());
+      for (size_t i = 0; i < joint_names.size(); i++) {
+        auto search = parent_.jointSlotIndex.find(joint_names[i]);
+        command_layout_[i] = search != parent_.jointSlotIndex.end() ? static_cast<int>(search->second) : -1;
+      }
+      command_layout_names_ = joint_names;
+      return command_layout_;
+    }
+
+    void LCM2ROSControl_LCMHandler::publishPendingCommands(int64_t source_utime, int64_t receive_utime) {
+      pending_commands_.source_utime = source_utime;
+      pending_commands_.receive_utime = receive_utime;
+      pending_commands_.sequence++;
+
+      // hand the whole set over at once so update() never sees a partial message
+      parent_.commandMailbox.writeBuffer() = pending_commands_;
+      parent_.commandMailbox.publish();
+    }
+    void LCM2ROSControl_LCMHandler::announceSchema(int64_t utime){
+      if (command_schema_)
+        command_schema_->announce(utime);
+    }
+    void LCM2ROSControl_LCMHandler::update(const ros::Time& time){
+      hub_->poll(time);
+    }
+    void LCM2ROSControl_LCMHandler::startReceiveThread(){
+      if (receive_thread_requested_)
+        return;
+      receive_thread_requested_ = true;
+      hub_->startReceiveThread();
     }
-    void LCM2ROSControl_LCMHandler::update(){
-      lcm_->handleTimeout(0);
+    void LCM2ROSControl_LCMHandler::stopReceiveThread(){
+      if (!receive_thread_requested_)
+        return;
+      receive_thread_requested_ = false;
+      hub_->stopReceiveThread();
     }
   }
 
@@ -19,46 +19,89 @@
 #include "lcmtypes/bot_core/ins_t.hpp"
 #include "lcmtypes/bot_core/joint_angles_t.hpp"
 #include "lcmtypes/bot_core/atlas_command_t.hpp"
+#include "lcmtypes/valkyrie_translator/joint_command_compact_t.hpp"
 
+#include <atomic>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
 
+#include "CommandLatency.hpp"
+#include "CompactJointStatePublisher.hpp"
+#include "ControllerTiming.hpp"
+#include "EffortControlLaw.hpp"
+#include "JointSchemaAnnouncer.hpp"
+#include "LCMTransportHub.hpp"
+#include "RealtimeLCMPublisher.hpp"
+#include "RealtimeLog.hpp"
+#include "SharedCommandReceiver.hpp"
+#include "SharedStateWriter.hpp"
+#include "TripleBuffer.hpp"
+
 namespace valkyrie_translator
 {
 
-   typedef struct _joint_command {
-    double position;
-    double velocity;
-    double effort;
-
-    double k_q_p; // corresponds to kp_position in drcsim API
-    double k_q_i; // corresponds to ki_position in drcsim API
-    double k_qd_p; // corresponds to kp_velocity in drcsim API
-    double k_f_p;
-    double ff_qd; // maps to kd_position in drcsim API (there isnt an equivalent gain in the bdi api)
-    double ff_qd_d;
-    double ff_f_d;
-    double ff_const;
-   } joint_command;
+   /* One entry per claimed joint. Resolved once in initRequest (handle, limits
+      with defaults filled in) so that update() can walk the table linearly
+      instead of doing string-keyed map lookups every tick. */
+   typedef struct _joint_slot {
+    std::string name;
+    hardware_interface::JointHandle handle;
+    joint_limits_interface::JointLimits limits;
+   } joint_slot;
+
+   /* Complete set of joint commands, indexed by joint slot, tagged with the
+      utime of the atlas_command_t it came from, its LCM receive time and a
+      sequence number counting received messages (starting at 1). */
+   struct joint_command_set : public joint_command_arrays {
+    int64_t source_utime = 0;
+    int64_t receive_utime = 0;
+    uint32_t sequence = 0;
+   };
 
    class LCM2ROSControl;
 
-   /* Manages subscription for the LCM2ROSControl class.
-      Presently just a hack to resolve pluginlib compatibility issues... */
+   /* Manages the ROBOT_COMMAND subscription for the LCM2ROSControl class,
+      on the process-wide LCMTransportHub. With compact_commands set it also
+      announces the joint slot table on ROBOT_COMMAND_SCHEMA and accepts
+      slot-addressed commands on ROBOT_COMMAND_COMPACT. */
    class LCM2ROSControl_LCMHandler
    {
    public:
-        LCM2ROSControl_LCMHandler(LCM2ROSControl& parent);
+        LCM2ROSControl_LCMHandler(LCM2ROSControl& parent, const std::shared_ptr<LCMTransportHub>& hub);
         virtual ~LCM2ROSControl_LCMHandler();
         void jointCommandHandler(const lcm::ReceiveBuffer* rbuf, const std::string &channel,
                                const bot_core::atlas_command_t* msg);
-        void update();
+        void compactCommandHandler(const lcm::ReceiveBuffer* rbuf, const std::string &channel,
+                               const joint_command_compact_t* msg);
+        void update(const ros::Time& time);
+        // Realtime safe, called every tick regardless of the receive mode
+        void announceSchema(int64_t utime);
+        // Compact commands dropped so far because their schema_hash did not match
+        uint32_t rejectedCompactCommands() const { return rejected_compact_commands_; }
+        int64_t lastRejectedSchemaHash() const { return last_rejected_schema_hash_; }
+        void startReceiveThread();
+        void stopReceiveThread();
    private:
+        void publishPendingCommands(int64_t source_utime, int64_t receive_utime);
+        const std::vector<int>& commandLayout(const std::vector<std::string>& joint_names);
+
         LCM2ROSControl& parent_;
-        // If the subscription is created on LCM2ROSControl's lcm_ object, we see pluginlib
-        // compatibility problems. Mysterious and scary...
-        std::shared_ptr<lcm::LCM> lcm_;
+        // Last received command for every slot; joints missing from a message
+        // keep their previous command. Copied whole into the mailbox.
+        joint_command_set pending_commands_;
+        // Slot (or -1) for each entry of the last joint_names layout seen on
+        // ROBOT_COMMAND, and the names it was built from
+        std::vector<int> command_layout_;
+        std::vector<std::string> command_layout_names_;
+        std::shared_ptr<LCMTransportHub> hub_;
+        lcm::Subscription* subscription_;
+        lcm::Subscription* compact_subscription_;
+        std::unique_ptr<JointSchemaAnnouncer> command_schema_;
+        std::atomic<uint32_t> rejected_compact_commands_;
+        std::atomic<int64_t> last_rejected_schema_hash_;
+        bool receive_thread_requested_;
    };
 
    class LCM2ROSControl : public controller_interface::Controller<hardware_interface::EffortJointInterface>
@@ -73,13 +116,23 @@ namespace valkyrie_translator
 
         // Public so it can be modified by the LCMHandler. Should eventually create
         // a friend class arrangement to make this private again.
-        std::map<std::string, joint_command> latest_commands;
+        // Effort-controlled joints occupy [0, numberOfEffortJoints), followed by
+        // the position-controlled joints.
+        std::vector<joint_slot> joints;
+        size_t numberOfEffortJoints = 0;
+        std::map<std::string, size_t> jointSlotIndex;
+        // Written by the LCMHandler, picked up by update() with a single swap.
+        TripleBuffer<joint_command_set> commandMailbox;
         bool publishCoreRobotState = true;
+        bool compactCoreRobotState = false;
+        bool compactCommands = false;
         bool publish_est_robot_state = false;
         bool applyCommands = false;
+        bool useReceiveThread = false;
 
         double FORCE_CONTROL_ALLOWABLE_POSITION_ERR_BOUND = 0.1;
         double FORCE_CONTROL_MAX_CHANGE = 100.0;
+        double FORCE_CONTROL_HARD_LIMIT = 1000.0;
         double DEFAULT_MIN_POSITION = -M_PI;
         double DEFAULT_MAX_POSITION = M_PI;
         double DEFAULT_MAX_EFFORT = 1000.0;
@@ -92,11 +145,46 @@ namespace valkyrie_translator
                          std::set<std::string>& claimed_resources) override;
 
    private:
-        boost::shared_ptr<lcm::LCM> lcm_;
+        std::shared_ptr<LCMTransportHub> hub_;
+        std::shared_ptr<lcm::LCM> lcm_;
         std::shared_ptr<LCM2ROSControl_LCMHandler> handler_;
 
-        std::map<std::string, hardware_interface::JointHandle> effortJointHandles;
-        std::map<std::string, hardware_interface::JointHandle> positionJointHandles;
+        // State messages, preallocated with joint names filled in by initStateMessages()
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::joint_state_t> > coreRobotStatePub;
+        std::unique_ptr<CompactJointStatePublisher> compactCoreRobotStatePub;  // when compact_core_robot_state is set
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::robot_state_t> > estRobotStatePub;
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::joint_state_t> > commandFeedbackPub;
+        std::unique_ptr<RealtimeLCMPublisher<bot_core::joint_angles_t> > commandFeedbackTorquePub;
+
+        // Per-tick measurements, computed and safety-limited efforts for the effort-controlled joints
+        aligned_vector measuredPosition;
+        aligned_vector measuredVelocity;
+        aligned_vector measuredEffort;
+        aligned_vector commandedEffort;
+        aligned_vector limitedEffort;
+        std::vector<uint8_t> effortLimitEvents;
+        effort_limit_arrays effortLimits;
+
+        void addJointSlot(const std::string& name, const hardware_interface::JointHandle& handle);
+        void initStateMessages();
+        void reportEffortLimitEvents();
+        void writeSharedState(int64_t utime);
+
+        // Messages from the control loop, formatted and rate-limited off the RT thread
+        std::unique_ptr<RealtimeLogger> logger_;
+        // Per-phase update() timing, only created when timing_stats_channel is set
+        std::unique_ptr<ControllerTiming> timing_;
+        // Age of commands when they reach the joints, unless command_latency_channel is empty
+        std::unique_ptr<CommandLatencyTracker> latencyTracker;
+        // Joint, IMU and force-torque state for consumers on this host, only opened when shared_state_name is set
+        std::unique_ptr<SharedStateWriter> sharedState;
+        // Commands from a co-located process, only opened when shared_command_name is set.
+        // Whichever of ROBOT_COMMAND and the ring delivered last is in effect.
+        std::unique_ptr<SharedCommandReceiver> sharedCommands;
+        joint_command_set sharedCommandSet;
+        bool sharedCommandsActive = false;
+        uint32_t reportedCompactRejections = 0;
+
         std::map<std::string, hardware_interface::ImuSensorHandle> imuSensorHandles;
         std::map<std::string, hardware_interface::ForceTorqueSensorHandle> forceTorqueHandles;
 
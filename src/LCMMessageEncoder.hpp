@@ -0,0 +1,212 @@
+#ifndef LCMMESSAGEENCODER_HPP
+#define LCMMESSAGEENCODER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "lcmtypes/bot_core/joint_state_t.hpp"
+#include "lcmtypes/bot_core/robot_state_t.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Helpers writing LCM's big-endian wire format directly into a buffer. */
+   namespace lcm_wire
+   {
+        inline uint32_t toBigEndian(uint32_t x)
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+          return x;
+#else
+          return __builtin_bswap32(x);
+#endif
+        }
+
+        inline uint64_t toBigEndian(uint64_t x)
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+          return x;
+#else
+          return __builtin_bswap64(x);
+#endif
+        }
+
+        inline void putInt64(uint8_t* dst, int64_t value)
+        {
+          uint64_t bits = toBigEndian(static_cast<uint64_t>(value));
+          memcpy(dst, &bits, sizeof(bits));
+        }
+
+        // Byte-swaps n floats into dst, four at a time when SSSE3 is available.
+        inline void putFloats(uint8_t* dst, const float* src, size_t n)
+        {
+          size_t i = 0;
+#if defined(__SSSE3__) && !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+          const __m128i reverse_each_word = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+          for (; i + 4 <= n; i += 4)
+          {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4 * i), _mm_shuffle_epi8(v, reverse_each_word));
+          }
+#endif
+          for (; i < n; i++)
+          {
+            uint32_t bits;
+            memcpy(&bits, src + i, sizeof(bits));
+            bits = toBigEndian(bits);
+            memcpy(dst + 4 * i, &bits, sizeof(bits));
+          }
+        }
+
+        inline size_t stringArraySize(const std::vector<std::string>& strings, size_t n)
+        {
+          size_t size = 0;
+          for (size_t i = 0; i < n; i++)
+            size += 4 + strings[i].size() + 1;  // int32 length, characters, terminating null
+          return size;
+        }
+   }
+
+   /* Produces the encoded bytes of a message for RealtimeLCMPublisher.
+
+      The generic version simply encodes the whole message every time. The
+      specialisations below handle joint_state_t and robot_state_t, whose
+      joint names and array lengths are fixed after initRequest: the message
+      is fully encoded once, and afterwards only utime and the numeric fields
+      are written in place at byte offsets recorded during that first encode.
+      If num_joints changes, the template is rebuilt. Changing joint names
+      without changing their number is not detected. */
+   template <class Msg>
+   class LCMMessageEncoder
+   {
+   public:
+        // Returns the number of encoded bytes, or -1 on failure.
+        int encode(const Msg& msg)
+        {
+          int size = msg.getEncodedSize();
+          if (buffer_.size() < static_cast<size_t>(size))
+            buffer_.resize(size);
+          return msg.encode(buffer_.data(), 0, size) < 0 ? -1 : size;
+        }
+
+        const uint8_t* data() const { return buffer_.data(); }
+
+   private:
+        std::vector<uint8_t> buffer_;
+   };
+
+   template <>
+   class LCMMessageEncoder<bot_core::joint_state_t>
+   {
+   public:
+        LCMMessageEncoder() : num_joints_(-1), size_(0) {}
+
+        int encode(const bot_core::joint_state_t& msg)
+        {
+          if (msg.num_joints != num_joints_ && !buildTemplate(msg))
+            return -1;
+
+          size_t n = static_cast<size_t>(num_joints_);
+          lcm_wire::putInt64(&buffer_[UTIME_OFFSET], msg.utime);
+          lcm_wire::putFloats(&buffer_[position_offset_], msg.joint_position.data(), n);
+          lcm_wire::putFloats(&buffer_[position_offset_ + 4 * n], msg.joint_velocity.data(), n);
+          lcm_wire::putFloats(&buffer_[position_offset_ + 8 * n], msg.joint_effort.data(), n);
+          return size_;
+        }
+
+        const uint8_t* data() const { return buffer_.data(); }
+
+   private:
+        // 8 byte fingerprint, then utime
+        static const size_t UTIME_OFFSET = 8;
+
+        bool buildTemplate(const bot_core::joint_state_t& msg)
+        {
+          num_joints_ = -1;
+          size_t n = static_cast<size_t>(msg.num_joints);
+          size_ = msg.getEncodedSize();
+          buffer_.resize(size_);
+          if (msg.encode(buffer_.data(), 0, size_) < 0)
+            return false;
+
+          // utime, int16 num_joints, joint_name[], then the three float arrays
+          position_offset_ = UTIME_OFFSET + 8 + 2 + lcm_wire::stringArraySize(msg.joint_name, n);
+          if (position_offset_ + 12 * n != static_cast<size_t>(size_))
+            return false;
+
+          num_joints_ = msg.num_joints;
+          return true;
+        }
+
+        std::vector<uint8_t> buffer_;
+        int num_joints_;
+        int size_;
+        size_t position_offset_;
+   };
+
+   template <>
+   class LCMMessageEncoder<bot_core::robot_state_t>
+   {
+   public:
+        LCMMessageEncoder() : num_joints_(-1), size_(0) {}
+
+        int encode(const bot_core::robot_state_t& msg)
+        {
+          if (msg.num_joints != num_joints_ && !buildTemplate(msg))
+            return -1;
+
+          size_t n = static_cast<size_t>(num_joints_);
+          int maxlen = size_;
+          lcm_wire::putInt64(&buffer_[UTIME_OFFSET], msg.utime);
+          // pose, twist and force_torque are small fixed-size structs
+          msg.pose._encodeNoHash(buffer_.data(), POSE_OFFSET, maxlen);
+          msg.twist._encodeNoHash(buffer_.data(), twist_offset_, maxlen);
+          lcm_wire::putFloats(&buffer_[position_offset_], msg.joint_position.data(), n);
+          lcm_wire::putFloats(&buffer_[position_offset_ + 4 * n], msg.joint_velocity.data(), n);
+          lcm_wire::putFloats(&buffer_[position_offset_ + 8 * n], msg.joint_effort.data(), n);
+          msg.force_torque._encodeNoHash(buffer_.data(), force_torque_offset_, maxlen);
+          return size_;
+        }
+
+        const uint8_t* data() const { return buffer_.data(); }
+
+   private:
+        static const size_t UTIME_OFFSET = 8;
+        static const size_t POSE_OFFSET = 16;
+
+        bool buildTemplate(const bot_core::robot_state_t& msg)
+        {
+          num_joints_ = -1;
+          size_t n = static_cast<size_t>(msg.num_joints);
+          size_ = msg.getEncodedSize();
+          buffer_.resize(size_);
+          if (msg.encode(buffer_.data(), 0, size_) < 0)
+            return false;
+
+          // utime, pose, twist, int16 num_joints, joint_name[], three float arrays, force_torque
+          twist_offset_ = POSE_OFFSET + msg.pose._getEncodedSizeNoHash();
+          position_offset_ = twist_offset_ + msg.twist._getEncodedSizeNoHash() + 2 +
+                             lcm_wire::stringArraySize(msg.joint_name, n);
+          force_torque_offset_ = position_offset_ + 12 * n;
+          if (force_torque_offset_ + msg.force_torque._getEncodedSizeNoHash() != static_cast<size_t>(size_))
+            return false;
+
+          num_joints_ = msg.num_joints;
+          return true;
+        }
+
+        std::vector<uint8_t> buffer_;
+        int num_joints_;
+        int size_;
+        size_t twist_offset_;
+        size_t position_offset_;
+        size_t force_torque_offset_;
+   };
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef LCMRECEIVETHREAD_HPP
+#define LCMRECEIVETHREAD_HPP
+
+#include <poll.h>
+
+#include <atomic>
+#include <cerrno>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <lcm/lcm-cpp.hpp>
+
+namespace valkyrie_translator
+{
+
+   /* Services an lcm::LCM instance from its own (non-realtime) thread.
+
+      Waits in poll() on the LCM file descriptor and dispatches messages as
+      they arrive, so subscription handlers decode off the control loop.
+      Dispatching never blocks, so stop() returns within POLL_TIMEOUT_MS;
+      it joins the thread, so call it from a non-realtime context. The
+      handlers are responsible for passing their results to the realtime side
+      through an RT-safe channel (see TripleBuffer). If a dispatch mutex is
+      given it is held while handling, so that other threads can safely
+      subscribe and unsubscribe in between. */
+   class LCMReceiveThread
+   {
+   public:
+        explicit LCMReceiveThread(const std::shared_ptr<lcm::LCM>& lcm, std::mutex* dispatch_mutex = nullptr)
+          : lcm_(lcm), dispatch_mutex_(dispatch_mutex), running_(false) {}
+
+        ~LCMReceiveThread()
+        {
+          stop();
+        }
+
+        void start()
+        {
+          if (running_)
+            return;
+          running_ = true;
+          thread_ = std::thread(&LCMReceiveThread::run, this);
+        }
+
+        void stop()
+        {
+          running_ = false;
+          if (thread_.joinable())
+            thread_.join();
+        }
+
+   private:
+        // Upper bound on how long stop() waits for the thread to notice.
+        static const int POLL_TIMEOUT_MS = 100;
+
+        void run()
+        {
+          struct pollfd fds;
+          fds.fd = lcm_->getFileno();
+          fds.events = POLLIN;
+
+          while (running_)
+          {
+            int ret = poll(&fds, 1, POLL_TIMEOUT_MS);
+            if (ret > 0 && (fds.revents & POLLIN))
+            {
+              // a readable socket need not hold a whole message for this instance
+              if (dispatch_mutex_)
+              {
+                std::lock_guard<std::mutex> lock(*dispatch_mutex_);
+                lcm_->handleTimeout(0);
+              }
+              else
+              {
+                lcm_->handleTimeout(0);
+              }
+            }
+            else if (ret < 0 && errno != EINTR)
+            {
+              std::cerr << "ERROR: poll() on LCM file descriptor failed, receive thread exiting" << std::endl;
+              running_ = false;
+            }
+          }
+        }
+
+        std::shared_ptr<lcm::LCM> lcm_;
+        std::mutex* dispatch_mutex_;
+        std::atomic<bool> running_;
+        std::thread thread_;
+   };
+}
+#endif
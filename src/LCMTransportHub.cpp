@@ -0,0 +1,79 @@
+#include "LCMTransportHub.hpp"
+
+#include <iostream>
+
+namespace valkyrie_translator
+{
+  namespace
+  {
+    std::mutex hub_mutex;
+    std::weak_ptr<LCMTransportHub> hub_instance;
+  }
+
+  std::shared_ptr<LCMTransportHub> LCMTransportHub::acquire()
+  {
+    std::lock_guard<std::mutex> lock(hub_mutex);
+    std::shared_ptr<LCMTransportHub> hub = hub_instance.lock();
+    if (!hub)
+    {
+      hub.reset(new LCMTransportHub);
+      if (!hub->lcm_->good())
+      {
+        std::cerr << "ERROR: lcm is not good()" << std::endl;
+        return std::shared_ptr<LCMTransportHub>();
+      }
+      hub_instance = hub;
+    }
+    return hub;
+  }
+
+  LCMTransportHub::LCMTransportHub()
+    : lcm_(new lcm::LCM), receive_thread_users_(0)
+  {}
+
+  LCMTransportHub::~LCMTransportHub()
+  {
+    if (receive_thread_)
+      receive_thread_->stop();
+  }
+
+  void LCMTransportHub::unsubscribe(lcm::Subscription* subscription)
+  {
+    if (!subscription)
+      return;
+    std::lock_guard<std::mutex> lock(dispatch_mutex_);
+    lcm_->unsubscribe(subscription);
+  }
+
+  void LCMTransportHub::poll(const ros::Time& time)
+  {
+    std::unique_lock<std::mutex> lock(dispatch_mutex_, std::try_to_lock);
+    if (!lock.owns_lock() || receive_thread_users_ > 0 || time == last_poll_time_)
+      return;
+    last_poll_time_ = time;
+
+    for (int i = 0; i < MAX_MESSAGES_PER_POLL; i++)
+    {
+      if (lcm_->handleTimeout(0) <= 0)
+        break;
+    }
+  }
+
+  void LCMTransportHub::startReceiveThread()
+  {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (receive_thread_users_++ > 0)
+      return;
+    if (!receive_thread_)
+      receive_thread_.reset(new LCMReceiveThread(lcm_, &dispatch_mutex_));
+    receive_thread_->start();
+  }
+
+  void LCMTransportHub::stopReceiveThread()
+  {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (receive_thread_users_ == 0 || --receive_thread_users_ > 0)
+      return;
+    receive_thread_->stop();
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef LCMTRANSPORTHUB_HPP
+#define LCMTRANSPORTHUB_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <ros/time.h>
+#include <lcm/lcm-cpp.hpp>
+
+#include "LCMReceiveThread.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* One lcm::LCM instance (one multicast socket) shared by every translator
+      controller in the process.
+
+      acquire() hands out references to the process-wide hub, creating it on
+      first use; it is destroyed when the last controller lets go. Publishers
+      use lcm() directly; subscriptions go through subscribe()/unsubscribe() so
+      they can be changed safely while another thread is dispatching.
+
+      Incoming messages are dispatched either by poll(), which any number of
+      controllers may call from update() but which only reads the socket once
+      per control cycle, or by a single receive thread that runs while at least
+      one controller has asked for it (startReceiveThread()).
+
+      The hub's storage lives in the valkyrie_translator_lcm_hub library rather
+      than in a header, so the plugin libraries pluginlib dlopen()s with local
+      symbol visibility all resolve to the same instance instead of each
+      getting a private copy. */
+   class LCMTransportHub
+   {
+   public:
+        // The shared hub, or a null pointer if LCM could not be initialised.
+        static std::shared_ptr<LCMTransportHub> acquire();
+
+        ~LCMTransportHub();
+
+        const std::shared_ptr<lcm::LCM>& lcm() const { return lcm_; }
+
+        template<class MessageType, class MessageHandlerClass>
+        lcm::Subscription* subscribe(const std::string& channel,
+                                     void (MessageHandlerClass::*handlerMethod)(const lcm::ReceiveBuffer* rbuf,
+                                                                                const std::string& channel,
+                                                                                const MessageType* msg),
+                                     MessageHandlerClass* handler)
+        {
+          std::lock_guard<std::mutex> lock(dispatch_mutex_);
+          return lcm_->subscribe(channel, handlerMethod, handler);
+        }
+
+        void unsubscribe(lcm::Subscription* subscription);
+
+        // Handle whatever has arrived since the last call, at most once per
+        // control cycle (identified by its time). Never blocks: does nothing if
+        // the receive thread is running or another thread holds the dispatcher.
+        void poll(const ros::Time& time);
+
+        // Reference counted; the thread runs while any caller wants it.
+        void startReceiveThread();
+        void stopReceiveThread();
+
+   private:
+        LCMTransportHub();
+        LCMTransportHub(const LCMTransportHub&);
+        LCMTransportHub& operator=(const LCMTransportHub&);
+
+        // Bounds the work poll() does in one cycle if messages pile up.
+        static const int MAX_MESSAGES_PER_POLL = 32;
+
+        std::shared_ptr<lcm::LCM> lcm_;
+        std::mutex dispatch_mutex_;  // held while handling messages and changing subscriptions
+        ros::Time last_poll_time_;
+
+        std::mutex thread_mutex_;
+        std::atomic<int> receive_thread_users_;
+        std::unique_ptr<LCMReceiveThread> receive_thread_;
+   };
+}
+#endif
@@ -0,0 +1,94 @@
+#ifndef ONLINETRAJECTORY_HPP
+#define ONLINETRAJECTORY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace valkyrie_translator
+{
+
+   /* Time-optimal, velocity- and acceleration-limited motion towards a target
+      that may change at any time, one independent joint per entry.
+
+      Every step() accelerates each joint as hard as allowed towards its
+      target, along the fastest velocity from which it can still brake to
+      rest exactly on the target (the braking curve is taken for the
+      discrete integration, so joints land without overshoot or chatter).
+      Because the whole state is carried from tick to tick, a new target
+      simply bends the current motion instead of restarting it, which suits
+      streamed goals. A limit <= 0 means unlimited. */
+   class OnlineTrajectory
+   {
+   public:
+        void resize(size_t n)
+        {
+          std::vector<double>* fields[] = {&max_velocity_, &max_acceleration_, &position_,
+                                           &velocity_, &acceleration_, &target_};
+          for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+            fields[i]->assign(n, 0.0);
+        }
+
+        size_t size() const { return target_.size(); }
+
+        void setLimits(size_t i, double max_velocity, double max_acceleration)
+        {
+          max_velocity_[i] = max_velocity;
+          max_acceleration_[i] = max_acceleration;
+        }
+
+        // Puts joint i at q moving at qd, targeting q.
+        void reset(size_t i, double q, double qd = 0.0)
+        {
+          position_[i] = q;
+          target_[i] = q;
+          velocity_[i] = qd;
+          acceleration_[i] = 0.0;
+        }
+
+        void setTarget(size_t i, double q) { target_[i] = q; }
+        double target(size_t i) const { return target_[i]; }
+
+        const std::vector<double>& position() const { return position_; }
+        const std::vector<double>& velocity() const { return velocity_; }
+        const std::vector<double>& acceleration() const { return acceleration_; }
+
+        // Advances every joint by dt seconds.
+        void step(double dt)
+        {
+          if (dt <= 0.0)
+            return;
+          const double unlimited = std::numeric_limits<double>::infinity();
+          for (size_t i = 0; i < target_.size(); i++)
+          {
+            const double a = max_acceleration_[i];
+            const double v_max = max_velocity_[i] > 0.0 ? max_velocity_[i] : unlimited;
+            const double error = target_[i] - position_[i];
+            const double distance = std::fabs(error);
+
+            // fastest speed that still stops on the target, and never past it within this tick
+            double v_stop = distance / dt;
+            if (a > 0.0)
+              v_stop = std::min(v_stop, -0.5 * a * dt + std::sqrt(0.25 * a * a * dt * dt + 2.0 * a * distance));
+            double v_new = std::copysign(std::min(v_max, v_stop), error);
+            if (a > 0.0)
+              v_new = std::max(velocity_[i] - a * dt, std::min(velocity_[i] + a * dt, v_new));
+
+            acceleration_[i] = (v_new - velocity_[i]) / dt;
+            velocity_[i] = v_new;
+            position_[i] += v_new * dt;
+          }
+        }
+
+   private:
+        std::vector<double> max_velocity_;
+        std::vector<double> max_acceleration_;
+        std::vector<double> position_;
+        std::vector<double> velocity_;
+        std::vector<double> acceleration_;
+        std::vector<double> target_;
+   };
+}
+#endif
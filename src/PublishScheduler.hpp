@@ -0,0 +1,102 @@
+#ifndef PUBLISHSCHEDULER_HPP
+#define PUBLISHSCHEDULER_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <ros/console.h>
+
+namespace valkyrie_translator
+{
+
+   /* Decides which outbound channels to publish on a given control tick.
+
+      Each channel publishes every every_tics ticks at a fixed phase
+      (tick % every_tics == phase), or never if its frequency is not positive.
+      Channels registered without a phase get
+      the one that coincides with the fewest already-registered channels, so
+      slower channels end up spread over different ticks instead of all
+      bursting in the same cycle. Registration happens at init; due() and
+      advance() are cheap enough for the control loop. */
+   class PublishScheduler
+   {
+   public:
+        // update_frequency is the rate in Hz at which the controller's update() runs.
+        explicit PublishScheduler(double update_frequency) : update_frequency_(update_frequency), tick_(0) {}
+
+        // Register a channel publishing at frequency Hz (at most every tick, not
+        // at all if frequency <= 0); a negative phase picks the least loaded
+        // one. Returns the channel id.
+        size_t add(const std::string& name, double frequency, int phase = -1)
+        {
+          if (!(frequency > 0.0))
+          {
+            every_tics_.push_back(DISABLED);
+            phases_.push_back(0);
+            ROS_INFO_STREAM("Not publishing " << name << " (publish frequency " << frequency << ")");
+            return every_tics_.size() - 1;
+          }
+
+          int every_tics = 1;
+          if (frequency < update_frequency_)
+            every_tics = static_cast<int>(std::floor(update_frequency_ / frequency));
+
+          if (phase < 0)
+            phase = leastLoadedPhase(every_tics);
+          else
+            phase %= every_tics;
+
+          every_tics_.push_back(every_tics);
+          phases_.push_back(phase);
+          ROS_INFO_STREAM("Publishing " << name << " at " << update_frequency_ / every_tics << " Hz (every "
+                          << every_tics << " tics, phase " << phase << ")");
+          return every_tics_.size() - 1;
+        }
+
+        bool due(size_t channel) const
+        {
+          return every_tics_[channel] != DISABLED && static_cast<int>(tick_ % every_tics_[channel]) == phases_[channel];
+        }
+
+        void advance() { tick_++; }
+
+        // Ticks since the scheduler was created.
+        uint64_t tick() const { return tick_; }
+
+   private:
+        // Horizon over which phase choices are compared; channels slower than
+        // this are still spread, just with a coarser estimate of the load.
+        static const int LOAD_HORIZON = 1000;
+
+        // every_tics_ of a channel that never publishes
+        enum { DISABLED = 0 };
+
+        int leastLoadedPhase(int every_tics) const
+        {
+          int horizon = every_tics > LOAD_HORIZON ? every_tics : LOAD_HORIZON;
+          int best_phase = 0;
+          long best_load = -1;
+          for (int phase = 0; phase < every_tics; phase++)
+          {
+            long load = 0;
+            for (int tick = phase; tick < horizon; tick += every_tics)
+              for (size_t c = 0; c < every_tics_.size(); c++)
+                load += every_tics_[c] != DISABLED && tick % every_tics_[c] == phases_[c];
+            if (best_load < 0 || load < best_load)
+            {
+              best_load = load;
+              best_phase = phase;
+            }
+          }
+          return best_phase;
+        }
+
+        double update_frequency_;
+        uint64_t tick_;
+        std::vector<int> every_tics_;
+        std::vector<int> phases_;
+   };
+}
+#endif
@@ -0,0 +1,234 @@
+#ifndef QUINTICTRAJECTORY_HPP
+#define QUINTICTRAJECTORY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace valkyrie_translator
+{
+
+   /* Synchronised point-to-point moves for a group of joints.
+
+      plan() fits one quintic per joint from its current position, velocity
+      and acceleration to the goal at rest, all over the same duration, and
+      stores the coefficients as structure-of-arrays. evaluate() is then a
+      single Horner pass per joint. Starting from rest this is the
+      minimum-jerk profile, whose peak velocity is MIN_JERK_PEAK_VELOCITY
+      times the average; minimumDuration() picks the shortest duration for
+      which every joint's actual peaks, including those from stopping what it
+      is already doing, stay within its velocity and acceleration limits. */
+   class QuinticTrajectory
+   {
+   public:
+        static constexpr double MIN_JERK_PEAK_VELOCITY = 1.875;
+        static constexpr double MIN_JERK_PEAK_ACCELERATION = 5.7735;  // 10 / sqrt(3)
+        // However close the goal, a move takes at least this long
+        static constexpr double MIN_DURATION = 0.01;
+
+        QuinticTrajectory() : duration_(0.0) {}
+
+        // Sizes the group for n joints, all holding at 0.
+        void resize(size_t n)
+        {
+          std::vector<double>* fields[] = {&c0_, &c1_, &c2_, &c3_, &c4_, &c5_, &goal_};
+          for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+            fields[i]->assign(n, 0.0);
+          duration_ = 0.0;
+        }
+
+        size_t size() const { return goal_.size(); }
+        double duration() const { return duration_; }
+
+        // Shortest duration, at least MIN_DURATION, for which no joint moving
+        // from (q0, v0, a0) to rest at q1 exceeds its max_velocity or
+        // max_acceleration at any point, or the velocity and acceleration it
+        // starts with where those are higher. Entries <= 0 do not constrain it.
+        static double minimumDuration(const double* q0, const double* v0, const double* a0, const double* q1,
+                                      const double* max_velocity, const double* max_acceleration, size_t n)
+        {
+          // Start from the minimum-jerk duration, exact from rest, and from the
+          // time needed just to stop; then stretch until the peaks fit. Should
+          // none fit, e.g. when a joint starts above its limit and still
+          // accelerating, take the duration that came closest.
+          double duration = MIN_DURATION;
+          for (size_t i = 0; i < n; i++)
+          {
+            const double distance = std::fabs(q1[i] - q0[i]);
+            if (max_velocity[i] > 0.0)
+              duration = std::max(duration, MIN_JERK_PEAK_VELOCITY * distance / max_velocity[i]);
+            if (max_acceleration[i] > 0.0)
+            {
+              const double acceleration = std::max(max_acceleration[i], std::fabs(a0[i]));
+              duration = std::max(duration, std::sqrt(MIN_JERK_PEAK_ACCELERATION * distance / acceleration));
+              duration = std::max(duration, std::fabs(v0[i]) / acceleration);
+            }
+          }
+          double best = duration, best_excess = HUGE_VAL;
+          for (int attempt = 0; attempt < MAX_STRETCHES; attempt++, duration *= STRETCH)
+          {
+            const double excess = limitExcess(q0, v0, a0, q1, max_velocity, max_acceleration, n, duration);
+            if (excess <= 1.0 + LIMIT_TOLERANCE)
+              return duration;
+            if (excess < best_excess)
+            {
+              best = duration;
+              best_excess = excess;
+            }
+          }
+          return best;
+        }
+
+        // Plans every joint from (q0, v0, a0) to (q1, 0, 0) over duration seconds.
+        // A duration of zero jumps straight to the goal.
+        void plan(const double* q0, const double* v0, const double* a0, const double* q1, double duration)
+        {
+          duration_ = duration > 0.0 ? duration : 0.0;
+          const double T = duration_;
+          for (size_t i = 0; i < goal_.size(); i++)
+          {
+            goal_[i] = q1[i];
+            if (T == 0.0)
+            {
+              c0_[i] = q1[i];
+              c1_[i] = c2_[i] = c3_[i] = c4_[i] = c5_[i] = 0.0;
+              continue;
+            }
+            const double h = q1[i] - q0[i];
+            const double vT = v0[i] * T;
+            const double aT2 = a0[i] * T * T;
+            const double T3 = T * T * T;
+            c0_[i] = q0[i];
+            c1_[i] = v0[i];
+            c2_[i] = 0.5 * a0[i];
+            c3_[i] = (20.0 * h - 12.0 * vT - 3.0 * aT2) / (2.0 * T3);
+            c4_[i] = (-30.0 * h + 16.0 * vT + 3.0 * aT2) / (2.0 * T3 * T);
+            c5_[i] = (12.0 * h - 6.0 * vT - aT2) / (2.0 * T3 * T * T);
+          }
+        }
+
+        // Position, velocity and acceleration t seconds after plan(); past the
+        // end the goal is held exactly.
+        void evaluate(double t, double* q, double* qd, double* qdd) const
+        {
+          const size_t n = goal_.size();
+          if (t >= duration_)
+          {
+            for (size_t i = 0; i < n; i++)
+            {
+              q[i] = goal_[i];
+              qd[i] = 0.0;
+              qdd[i] = 0.0;
+            }
+            return;
+          }
+          if (t < 0.0)
+            t = 0.0;
+          for (size_t i = 0; i < n; i++)
+          {
+            q[i] = c0_[i] + t * (c1_[i] + t * (c2_[i] + t * (c3_[i] + t * (c4_[i] + t * c5_[i]))));
+            qd[i] = c1_[i] + t * (2.0 * c2_[i] + t * (3.0 * c3_[i] + t * (4.0 * c4_[i] + t * 5.0 * c5_[i])));
+            qdd[i] = 2.0 * c2_[i] + t * (6.0 * c3_[i] + t * (12.0 * c4_[i] + t * 20.0 * c5_[i]));
+          }
+        }
+
+   private:
+        static constexpr int MAX_STRETCHES = 40;
+        static constexpr double STRETCH = 1.2;
+        // Rounding error allowed over a limit, which exact minimum-jerk peaks meet
+        static constexpr double LIMIT_TOLERANCE = 1e-9;
+
+        // Largest ratio of any joint's peak velocity or acceleration over the
+        // move to what it may reach; at most 1 when all are within limits.
+        static double limitExcess(const double* q0, const double* v0, const double* a0, const double* q1,
+                                  const double* max_velocity, const double* max_acceleration, size_t n,
+                                  double duration)
+        {
+          double excess = 0.0;
+          for (size_t i = 0; i < n; i++)
+          {
+            if (max_velocity[i] <= 0.0 && max_acceleration[i] <= 0.0)
+              continue;
+            double peak_velocity, peak_acceleration;
+            peaks(q1[i] - q0[i], v0[i], a0[i], duration, peak_velocity, peak_acceleration);
+            if (max_velocity[i] > 0.0)
+              excess = std::max(excess, peak_velocity / std::max(max_velocity[i], std::fabs(v0[i])));
+            if (max_acceleration[i] > 0.0)
+              excess = std::max(excess, peak_acceleration / std::max(max_acceleration[i], std::fabs(a0[i])));
+          }
+          return excess;
+        }
+
+        // Largest |velocity| and |acceleration| of the quintic from (0, v0, a0)
+        // to (h, 0, 0) over T > 0 seconds.
+        static void peaks(double h, double v0, double a0, double T, double& peak_velocity, double& peak_acceleration)
+        {
+          // Over s = t / T the position is the sum of b_k s^k; T times the
+          // velocity, T^2 times the acceleration and T^3 times the jerk are
+          // its derivatives.
+          const double b1 = v0 * T;
+          const double b2 = 0.5 * a0 * T * T;
+          const double b3 = 10.0 * h - 6.0 * b1 - 3.0 * b2;
+          const double b4 = -15.0 * h + 8.0 * b1 + 3.0 * b2;
+          const double b5 = 6.0 * h - 3.0 * b1 - b2;
+          auto velocity = [&](double s) { return b1 + s * (2.0 * b2 + s * (3.0 * b3 + s * (4.0 * b4 + s * 5.0 * b5))); };
+          auto acceleration = [&](double s) { return 2.0 * b2 + s * (6.0 * b3 + s * (12.0 * b4 + s * 20.0 * b5)); };
+
+          // The acceleration peaks at the ends or where the jerk,
+          // 6 (b3 + 4 b4 s + 10 b5 s^2), vanishes, and is monotonic in between.
+          double edges[4];
+          int count = 0;
+          edges[count++] = 0.0;
+          const double qa = 10.0 * b5, qb = 4.0 * b4, qc = b3;
+          if (std::fabs(qa) > 1e-12 * (std::fabs(qb) + std::fabs(qc)))
+          {
+            const double discriminant = qb * qb - 4.0 * qa * qc;
+            if (discriminant > 0.0)
+            {
+              const double root = std::sqrt(discriminant);
+              double s0 = (-qb - root) / (2.0 * qa), s1 = (-qb + root) / (2.0 * qa);
+              if (s0 > s1)
+                std::swap(s0, s1);
+              if (s0 > 0.0 && s0 < 1.0)
+                edges[count++] = s0;
+              if (s1 > 0.0 && s1 < 1.0)
+                edges[count++] = s1;
+            }
+          }
+          else if (qb != 0.0 && -qc / qb > 0.0 && -qc / qb < 1.0)
+            edges[count++] = -qc / qb;
+          edges[count++] = 1.0;
+
+          // The velocity peaks at the ends or where the acceleration crosses
+          // zero, found by bisection within each monotonic piece.
+          double max_velocity = std::max(std::fabs(velocity(0.0)), std::fabs(velocity(1.0)));
+          double max_acceleration = 0.0;
+          for (int k = 0; k < count; k++)
+            max_acceleration = std::max(max_acceleration, std::fabs(acceleration(edges[k])));
+          for (int k = 0; k + 1 < count; k++)
+          {
+            double lo = edges[k], hi = edges[k + 1];
+            const double a_lo = acceleration(lo);
+            if ((a_lo > 0.0) == (acceleration(hi) > 0.0))
+              continue;
+            for (int iteration = 0; iteration < 40; iteration++)
+            {
+              const double mid = 0.5 * (lo + hi);
+              if ((acceleration(mid) > 0.0) == (a_lo > 0.0))
+                lo = mid;
+              else
+                hi = mid;
+            }
+            max_velocity = std::max(max_velocity, std::fabs(velocity(0.5 * (lo + hi))));
+          }
+          peak_velocity = max_velocity / T;
+          peak_acceleration = max_acceleration / (T * T);
+        }
+
+        std::vector<double> c0_, c1_, c2_, c3_, c4_, c5_;
+        std::vector<double> goal_;
+        double duration_;
+   };
+}
+#endif
@@ -0,0 +1,123 @@
+#ifndef REALTIMELCMPUBLISHER_HPP
+#define REALTIMELCMPUBLISHER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <lcm/lcm-cpp.hpp>
+
+#include "LCMMessageEncoder.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* LCM counterpart of realtime_tools::RealtimePublisher.
+
+      The realtime thread fills msg_ between a successful trylock() and
+      unlockAndPublish(); a background thread then encodes the message and
+      sends it (see LCMMessageEncoder). If the previous message is still being encoded, trylock()
+      fails and the realtime side simply skips that publish, so a slow network
+      stack can never stretch the control cycle.
+
+      Usage from update():
+        if (pub->trylock()) {
+          pub->msg_.utime = utime;
+          ...
+          pub->unlockAndPublish();
+        }
+
+      Use lock()/unlock() to initialise msg_ from non-realtime code. */
+   template <class Msg>
+   class RealtimeLCMPublisher
+   {
+   public:
+        Msg msg_;
+
+        RealtimeLCMPublisher(const std::shared_ptr<lcm::LCM>& lcm, const std::string& channel)
+          : lcm_(lcm), channel_(channel), turn_(REALTIME), keep_running_(true)
+        {
+          thread_ = std::thread(&RealtimeLCMPublisher::publishingLoop, this);
+        }
+
+        ~RealtimeLCMPublisher()
+        {
+          {
+            std::lock_guard<std::mutex> guard(msg_mutex_);
+            keep_running_ = false;
+          }
+          updated_cond_.notify_one();
+          if (thread_.joinable())
+            thread_.join();
+        }
+
+        const std::string& channel() const { return channel_; }
+
+        bool trylock()
+        {
+          if (msg_mutex_.try_lock())
+          {
+            if (turn_ == REALTIME)
+              return true;
+            msg_mutex_.unlock();
+          }
+          return false;
+        }
+
+        void unlockAndPublish()
+        {
+          turn_ = NON_REALTIME;
+          msg_mutex_.unlock();
+          updated_cond_.notify_one();
+        }
+
+        void lock() { msg_mutex_.lock(); }
+
+        void unlock() { msg_mutex_.unlock(); }
+
+   private:
+        enum { REALTIME, NON_REALTIME };
+
+        RealtimeLCMPublisher(const RealtimeLCMPublisher&);
+        RealtimeLCMPublisher& operator=(const RealtimeLCMPublisher&);
+
+        void publishingLoop()
+        {
+          while (true)
+          {
+            int size;
+            {
+              std::unique_lock<std::mutex> guard(msg_mutex_);
+              while (turn_ != NON_REALTIME && keep_running_)
+                updated_cond_.wait(guard);
+              if (!keep_running_)
+                return;
+
+              // encode while holding the lock (pure CPU work), send after releasing it
+              size = encoder_.encode(msg_);
+              turn_ = REALTIME;
+            }
+
+            if (size >= 0)
+              lcm_->publish(channel_, encoder_.data(), size);
+            else
+              std::cerr << "ERROR: could not encode message for " << channel_ << std::endl;
+          }
+        }
+
+        std::shared_ptr<lcm::LCM> lcm_;
+        std::string channel_;
+
+        LCMMessageEncoder<Msg> encoder_;
+        std::mutex msg_mutex_;
+        std::condition_variable updated_cond_;
+        int turn_;
+        bool keep_running_;
+        std::thread thread_;
+   };
+}
+#endif
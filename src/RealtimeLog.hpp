@@ -0,0 +1,212 @@
+#ifndef REALTIMELOG_HPP
+#define REALTIMELOG_HPP
+
+#include <ros/console.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace valkyrie_translator
+{
+
+   /* Deferred logging for the control loop.
+
+      The realtime thread calls log() with an event code, a joint index and up
+      to three numbers; this only copies a small record into a lock-free
+      single-producer/single-consumer ring (dropping it if the ring is full).
+      A background thread drains the ring, formats the records with the
+      printf-style format registered for their code (a %s for the joint name
+      followed by up to three %f), and prints them through ROS_INFO. Values
+      that do not survive a round trip through double, such as 64-bit hashes,
+      go through logInteger(), whose format has a %lld after the %s. Repeats
+      of the same code for the same joint within min_interval seconds are
+      counted instead of printed, and the count is appended to the next
+      message that does get printed. */
+   class RealtimeLogger
+   {
+   public:
+        RealtimeLogger(const std::vector<std::string>& names, size_t capacity = 1024, double min_interval = 1.0)
+          : names_(names), buffer_(roundUpToPowerOfTwo(capacity)), mask_(buffer_.size() - 1),
+            min_interval_(min_interval), head_(0), tail_(0), dropped_(0), running_(false)
+        {}
+
+        ~RealtimeLogger()
+        {
+          stop();
+        }
+
+        // Not thread-safe: register all codes before start().
+        void registerEvent(uint16_t code, const std::string& format)
+        {
+          formats_[code] = format;
+        }
+
+        void start()
+        {
+          if (running_)
+            return;
+          running_ = true;
+          thread_ = std::thread(&RealtimeLogger::drainLoop, this);
+        }
+
+        void stop()
+        {
+          running_ = false;
+          if (thread_.joinable())
+            thread_.join();
+          drain();
+        }
+
+        // Realtime-safe; returns false if the record had to be dropped.
+        bool log(uint16_t code, uint16_t index, double a0 = 0.0, double a1 = 0.0, double a2 = 0.0)
+        {
+          size_t head = head_.load(std::memory_order_relaxed);
+          if (head - tail_.load(std::memory_order_acquire) > mask_)
+          {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+          event& e = buffer_[head & mask_];
+          e.code = code;
+          e.index = index;
+          e.has_integer = false;
+          e.integer = 0;
+          e.args[0] = a0;
+          e.args[1] = a1;
+          e.args[2] = a2;
+          head_.store(head + 1, std::memory_order_release);
+          return true;
+        }
+
+        // Like log(), with an exact 64-bit integer before the numbers.
+        bool logInteger(uint16_t code, uint16_t index, int64_t integer, double a0 = 0.0, double a1 = 0.0)
+        {
+          size_t head = head_.load(std::memory_order_relaxed);
+          if (head - tail_.load(std::memory_order_acquire) > mask_)
+          {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+          event& e = buffer_[head & mask_];
+          e.code = code;
+          e.index = index;
+          e.has_integer = true;
+          e.integer = integer;
+          e.args[0] = a0;
+          e.args[1] = a1;
+          e.args[2] = 0.0;
+          head_.store(head + 1, std::memory_order_release);
+          return true;
+        }
+
+   private:
+        struct event
+        {
+          uint16_t code;
+          uint16_t index;
+          bool has_integer;
+          int64_t integer;
+          double args[3];
+        };
+
+        struct history
+        {
+          history() : suppressed(0) {}
+          std::chrono::steady_clock::time_point last_printed;
+          unsigned long suppressed;
+        };
+
+        static size_t roundUpToPowerOfTwo(size_t n)
+        {
+          size_t size = 1;
+          while (size < n)
+            size <<= 1;
+          return size;
+        }
+
+        void drainLoop()
+        {
+          while (running_)
+          {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          }
+        }
+
+        void drain()
+        {
+          size_t tail = tail_.load(std::memory_order_relaxed);
+          size_t head = head_.load(std::memory_order_acquire);
+          for (; tail != head; tail++)
+          {
+            event e = buffer_[tail & mask_];
+            tail_.store(tail + 1, std::memory_order_release);
+            print(e);
+          }
+
+          dropped_history_.suppressed += dropped_.exchange(0, std::memory_order_relaxed);
+          std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+          if (dropped_history_.suppressed > 0 &&
+              std::chrono::duration<double>(now - dropped_history_.last_printed).count() >= min_interval_)
+          {
+            ROS_WARN("Realtime log buffer full, dropped %lu messages", dropped_history_.suppressed);
+            dropped_history_.last_printed = now;
+            dropped_history_.suppressed = 0;
+          }
+        }
+
+        void print(const event& e)
+        {
+          std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+          history& h = history_[std::make_pair(e.code, e.index)];
+          if (h.last_printed.time_since_epoch().count() != 0 &&
+              std::chrono::duration<double>(now - h.last_printed).count() < min_interval_)
+          {
+            h.suppressed++;
+            return;
+          }
+
+          auto format = formats_.find(e.code);
+          const char* name = e.index < names_.size() ? names_[e.index].c_str() : "?";
+          char message[256];
+          const long long integer = e.integer;
+          if (format == formats_.end() && e.has_integer)
+            snprintf(message, sizeof(message), "event %u for %s: %lld %f %f", e.code, name, integer, e.args[0], e.args[1]);
+          else if (format == formats_.end())
+            snprintf(message, sizeof(message), "event %u for %s: %f %f %f", e.code, name, e.args[0], e.args[1], e.args[2]);
+          else if (e.has_integer)
+            snprintf(message, sizeof(message), format->second.c_str(), name, integer, e.args[0], e.args[1]);
+          else
+            snprintf(message, sizeof(message), format->second.c_str(), name, e.args[0], e.args[1], e.args[2]);
+
+          if (h.suppressed > 0)
+            ROS_INFO("%s (%lu similar messages suppressed)", message, h.suppressed);
+          else
+            ROS_INFO("%s", message);
+          h.last_printed = now;
+          h.suppressed = 0;
+        }
+
+        std::vector<std::string> names_;
+        std::map<uint16_t, std::string> formats_;
+        std::map<std::pair<uint16_t, uint16_t>, history> history_;
+        history dropped_history_;
+
+        std::vector<event> buffer_;
+        size_t mask_;
+        double min_interval_;
+        std::atomic<size_t> head_;
+        std::atomic<size_t> tail_;
+        std::atomic<unsigned long> dropped_;
+        std::atomic<bool> running_;
+        std::thread thread_;
+   };
+}
+#endif
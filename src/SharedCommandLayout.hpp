@@ -0,0 +1,102 @@
+#ifndef SHAREDCOMMANDLAYOUT_HPP
+#define SHAREDCOMMANDLAYOUT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace valkyrie_translator
+{
+
+   /* Layout of the shared memory command ring LCM2ROSControl reads when
+      shared_command_name is set. LCM2ROSControl creates the region; a single
+      process on the same host writes commands into it (SharedCommandSender).
+      Anyone who can write the region can drive the joints: it is created
+      with shared_command_mode (default 0660, less the umask), so the sender
+      has to run as the controller's user or, with a umask that keeps group
+      write, in its group.
+
+        shared_command_header
+        slot_names   num_slots x char[SHARED_COMMAND_NAME_LENGTH]
+        entries      capacity  x shared_command_entry_size(num_slots) bytes
+
+      Slot names list the joint slots in LCM2ROSControl's order; commands
+      address joints by slot index. Each entry is one command message, the
+      counterpart of an atlas_command_t: a shared_command_entry followed by
+      num_commands shared_joint_command records. Joints a message does not
+      mention keep their previous command.
+
+      The sender fills entry head % capacity, stamping its sequence with
+      2 * head + 1 before and 2 * head + 2 after writing, then increments
+      head. The receiver applies every complete entry it has not seen yet, in
+      order, and skips entries that were overwritten before it got to them. */
+
+   static const uint32_t SHARED_COMMAND_MAGIC = 0x43435456;  // "VTCC"
+   static const uint32_t SHARED_COMMAND_VERSION = 1;
+   static const size_t SHARED_COMMAND_NAME_LENGTH = 64;
+
+   struct shared_command_header
+   {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t capacity;
+    uint64_t entry_size;
+    uint64_t slot_names_offset;
+    uint64_t entries_offset;
+    uint64_t total_size;
+    std::atomic<uint32_t> receiver_closed;  // set once LCM2ROSControl has gone away
+
+    alignas(64) std::atomic<uint64_t> head;  // number of entries ever written
+   };
+
+   struct shared_command_entry
+   {
+    std::atomic<uint64_t> sequence;
+    int64_t utime;  // as atlas_command_t.utime
+    uint32_t num_commands;
+    uint32_t reserved;
+   };
+
+   // Same fields as one joint of an atlas_command_t.
+   struct shared_joint_command
+   {
+    uint32_t slot;
+    uint32_t reserved;
+    double position;
+    double velocity;
+    double effort;
+    double k_q_p;
+    double k_q_i;
+    double k_qd_p;
+    double k_f_p;
+    double ff_qd;
+    double ff_qd_d;
+    double ff_f_d;
+    double ff_const;
+   };
+
+   // The joint records directly following an entry.
+   inline shared_joint_command* sharedCommandRecords(shared_command_entry* entry)
+   {
+    return reinterpret_cast<shared_joint_command*>(entry + 1);
+   }
+
+   inline uint64_t sharedCommandEntrySize(uint32_t num_slots)
+   {
+    uint64_t size = sizeof(shared_command_entry) + num_slots * sizeof(shared_joint_command);
+    return (size + 63) & ~static_cast<uint64_t>(63);
+   }
+
+   inline void computeSharedCommandLayout(shared_command_header& header, uint32_t num_slots, uint32_t capacity)
+   {
+    header.num_slots = num_slots;
+    header.capacity = capacity;
+    header.entry_size = sharedCommandEntrySize(num_slots);
+    header.slot_names_offset = (sizeof(shared_command_header) + 63) & ~static_cast<uint64_t>(63);
+    uint64_t names_end = header.slot_names_offset + num_slots * SHARED_COMMAND_NAME_LENGTH;
+    header.entries_offset = (names_end + 63) & ~static_cast<uint64_t>(63);
+    header.total_size = header.entries_offset + capacity * header.entry_size;
+   }
+}
+#endif
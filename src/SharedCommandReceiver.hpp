@@ -0,0 +1,206 @@
+#ifndef SHAREDCOMMANDRECEIVER_HPP
+#define SHAREDCOMMANDRECEIVER_HPP
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <ros/console.h>
+
+#include "EffortControlLaw.hpp"
+#include "SharedCommandLayout.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Receiving end of the shared memory command ring (see
+      SharedCommandLayout.hpp), owned by LCM2ROSControl.
+
+      open() creates the region and is not realtime safe. receive() is called
+      from update(): it applies every new command message to a command set
+      exactly as LCM2ROSControl_LCMHandler::jointCommandHandler does, without
+      decoding or name lookups, and only touches preallocated memory.
+
+      Whoever can write the region can write its header too, so after open()
+      the layout is only ever taken from the copy kept here, and every count
+      and slot read from an entry is bounded by it. */
+   class SharedCommandReceiver
+   {
+   public:
+        SharedCommandReceiver()
+          : header_(nullptr), num_slots_(0), capacity_(0), entry_size_(0), entries_offset_(0),
+            total_size_(0), next_(0), lost_(0)
+        {}
+
+        ~SharedCommandReceiver()
+        {
+          close();
+        }
+
+        // mode is the region's permission bits, less the process umask.
+        bool open(const std::string& name, const std::vector<std::string>& slot_names, uint32_t capacity,
+                  mode_t mode)
+        {
+          close();
+
+          shared_command_header layout;
+          computeSharedCommandLayout(layout, slot_names.size(), capacity);
+
+          shm_unlink(name.c_str());
+          int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, mode);
+          if (fd < 0)
+          {
+            ROS_ERROR("Could not create shared memory region %s: %s", name.c_str(), strerror(errno));
+            return false;
+          }
+          if (ftruncate(fd, layout.total_size) != 0)
+          {
+            ROS_ERROR("Could not size shared memory region %s: %s", name.c_str(), strerror(errno));
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+          }
+          void* memory = mmap(nullptr, layout.total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+          ::close(fd);
+          if (memory == MAP_FAILED)
+          {
+            ROS_ERROR("Could not map shared memory region %s: %s", name.c_str(), strerror(errno));
+            shm_unlink(name.c_str());
+            return false;
+          }
+          if (mlock(memory, layout.total_size) != 0)
+            ROS_WARN("Could not lock shared memory region %s in RAM, the control loop may page fault on it: %s",
+                     name.c_str(), strerror(errno));
+
+          name_ = name;
+          base_ = static_cast<char*>(memory);
+          header_ = new (memory) shared_command_header;
+          computeSharedCommandLayout(*header_, slot_names.size(), capacity);
+          num_slots_ = layout.num_slots;
+          capacity_ = layout.capacity;
+          entry_size_ = layout.entry_size;
+          entries_offset_ = layout.entries_offset;
+          total_size_ = layout.total_size;
+          header_->receiver_closed.store(0);
+          header_->head.store(0);
+          for (size_t i = 0; i < slot_names.size(); i++)
+            strncpy(base_ + header_->slot_names_offset + i * SHARED_COMMAND_NAME_LENGTH, slot_names[i].c_str(),
+                    SHARED_COMMAND_NAME_LENGTH - 1);
+          for (uint32_t i = 0; i < capacity; i++)
+            new (entry(i)) shared_command_entry;
+          scratch_.resize(slot_names.size());
+          next_ = 0;
+          lost_ = 0;
+
+          std::atomic_thread_fence(std::memory_order_release);
+          header_->version = SHARED_COMMAND_VERSION;
+          header_->magic = SHARED_COMMAND_MAGIC;
+          return true;
+        }
+
+        void close()
+        {
+          if (!header_)
+            return;
+          header_->receiver_closed.store(1, std::memory_order_release);
+          munmap(base_, total_size_);
+          shm_unlink(name_.c_str());
+          header_ = nullptr;
+        }
+
+        // Whether the sender has written anything receive() has not looked at yet.
+        bool pending() const { return header_->head.load(std::memory_order_acquire) != next_; }
+
+        /* Apply all complete messages written since the last call to commands
+           (indexed by slot), oldest first. Returns how many were applied and
+           sets source_utime to the utime of the newest one. */
+        size_t receive(joint_command_arrays& commands, int64_t& source_utime)
+        {
+          uint64_t head = header_->head.load(std::memory_order_acquire);
+          if (head < next_)
+            next_ = head;  // the sender restarted its count
+          if (head - next_ > capacity_)
+          {
+            lost_ += head - next_ - capacity_;
+            next_ = head - capacity_;
+          }
+
+          size_t applied = 0;
+          for (; next_ < head; next_++)
+          {
+            shared_command_entry* e = entry(next_ % capacity_);
+            uint64_t expected = 2 * next_ + 2;
+            if (e->sequence.load(std::memory_order_acquire) != expected)
+            {
+              lost_++;
+              continue;
+            }
+            int64_t utime = e->utime;
+            size_t count = std::min<size_t>(e->num_commands, scratch_.size());
+            memcpy(scratch_.data(), sharedCommandRecords(e), count * sizeof(shared_joint_command));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e->sequence.load(std::memory_order_relaxed) != expected)
+            {
+              lost_++;
+              continue;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+              const shared_joint_command& c = scratch_[i];
+              if (c.slot >= num_slots_)
+                continue;
+              commands.position[c.slot] = c.position;
+              commands.velocity[c.slot] = c.velocity;
+              commands.effort[c.slot] = c.effort;
+              commands.k_q_p[c.slot] = c.k_q_p;
+              commands.k_q_i[c.slot] = c.k_q_i;
+              commands.k_qd_p[c.slot] = c.k_qd_p;
+              commands.k_f_p[c.slot] = c.k_f_p;
+              commands.ff_qd[c.slot] = c.ff_qd;
+              commands.ff_qd_d[c.slot] = c.ff_qd_d;
+              commands.ff_f_d[c.slot] = c.ff_f_d;
+              commands.ff_const[c.slot] = c.ff_const;
+            }
+            source_utime = utime;
+            applied++;
+          }
+          return applied;
+        }
+
+        // Messages overwritten by the sender before they could be applied.
+        uint64_t lost() const { return lost_; }
+
+   private:
+        SharedCommandReceiver(const SharedCommandReceiver&);
+        SharedCommandReceiver& operator=(const SharedCommandReceiver&);
+
+        shared_command_entry* entry(uint64_t index)
+        {
+          return reinterpret_cast<shared_command_entry*>(base_ + entries_offset_ + index * entry_size_);
+        }
+
+        std::string name_;
+        char* base_;
+        shared_command_header* header_;
+        // layout as created by open(), never re-read from the region
+        uint32_t num_slots_;  // the local joint count, as the command sets written to
+        uint32_t capacity_;
+        uint64_t entry_size_;
+        uint64_t entries_offset_;
+        uint64_t total_size_;
+        std::vector<shared_joint_command> scratch_;
+        uint64_t next_;
+        uint64_t lost_;
+   };
+}
+#endif
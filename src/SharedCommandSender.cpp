@@ -0,0 +1,96 @@
+#include "SharedCommandSender.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace valkyrie_translator
+{
+  SharedCommandSender::SharedCommandSender() : base_(nullptr), size_(0), header_(nullptr)
+  {}
+
+  SharedCommandSender::~SharedCommandSender()
+  {
+    close();
+  }
+
+  bool SharedCommandSender::open(const std::string& name)
+  {
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(shared_command_header))
+    {
+      ::close(fd);
+      return false;
+    }
+    void* memory = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+      return false;
+
+    // magic and version are written last, so only trust the layout once they are valid
+    shared_command_header* header = static_cast<shared_command_header*>(memory);
+    bool valid = header->magic == SHARED_COMMAND_MAGIC && header->version == SHARED_COMMAND_VERSION;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid || header->total_size > static_cast<uint64_t>(st.st_size) ||
+        header->entry_size != sharedCommandEntrySize(header->num_slots))
+    {
+      munmap(memory, st.st_size);
+      return false;
+    }
+
+    base_ = static_cast<char*>(memory);
+    size_ = st.st_size;
+    header_ = header;
+    slot_names_.resize(header_->num_slots);
+    for (uint32_t i = 0; i < header_->num_slots; i++)
+    {
+      const char* slot_name = base_ + header_->slot_names_offset + i * SHARED_COMMAND_NAME_LENGTH;
+      slot_names_[i] = std::string(slot_name, strnlen(slot_name, SHARED_COMMAND_NAME_LENGTH));
+    }
+    return true;
+  }
+
+  void SharedCommandSender::close()
+  {
+    if (!header_)
+      return;
+    munmap(base_, size_);
+    base_ = nullptr;
+    header_ = nullptr;
+    slot_names_.clear();
+  }
+
+  int SharedCommandSender::slotIndex(const std::string& joint_name) const
+  {
+    auto it = std::find(slot_names_.begin(), slot_names_.end(), joint_name);
+    return it == slot_names_.end() ? -1 : static_cast<int>(it - slot_names_.begin());
+  }
+
+  bool SharedCommandSender::send(int64_t utime, const shared_joint_command* commands, uint32_t count)
+  {
+    if (!header_ || count > header_->num_slots)
+      return false;
+
+    uint64_t head = header_->head.load(std::memory_order_relaxed);
+    shared_command_entry* entry = reinterpret_cast<shared_command_entry*>(
+      base_ + header_->entries_offset + (head % header_->capacity) * header_->entry_size);
+
+    entry->sequence.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    entry->utime = utime;
+    entry->num_commands = count;
+    memcpy(sharedCommandRecords(entry), commands, count * sizeof(shared_joint_command));
+    entry->sequence.store(2 * head + 2, std::memory_order_release);
+    header_->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+}
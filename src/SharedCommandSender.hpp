@@ -0,0 +1,50 @@
+#ifndef SHAREDCOMMANDSENDER_HPP
+#define SHAREDCOMMANDSENDER_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SharedCommandLayout.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Sends joint commands to a co-located LCM2ROSControl through its shared
+      memory command ring (see SharedCommandLayout.hpp), as a faster
+      alternative to publishing atlas_command_t on ROBOT_COMMAND.
+
+      Look joints up with slotIndex() once after open(), then address them by
+      slot in every send(). Only one sender may use a ring at a time. If
+      receiverClosed() turns true the controller was restarted: reopen, and
+      look the slots up again. */
+   class SharedCommandSender
+   {
+   public:
+        SharedCommandSender();
+        ~SharedCommandSender();
+
+        bool open(const std::string& name);
+        void close();
+        bool isOpen() const { return header_ != nullptr; }
+        bool receiverClosed() const { return header_->receiver_closed.load(std::memory_order_acquire) != 0; }
+
+        const std::vector<std::string>& slotNames() const { return slot_names_; }
+
+        // Slot of the named joint, or -1 if the controller does not have it.
+        int slotIndex(const std::string& joint_name) const;
+
+        // Publish one command message covering count joints.
+        bool send(int64_t utime, const shared_joint_command* commands, uint32_t count);
+
+   private:
+        SharedCommandSender(const SharedCommandSender&);
+        SharedCommandSender& operator=(const SharedCommandSender&);
+
+        char* base_;
+        size_t size_;
+        shared_command_header* header_;
+        std::vector<std::string> slot_names_;
+   };
+}
+#endif
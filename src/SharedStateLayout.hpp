@@ -0,0 +1,107 @@
+#ifndef SHAREDSTATELAYOUT_HPP
+#define SHAREDSTATELAYOUT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace valkyrie_translator
+{
+
+   /* Layout of the robot state exported to POSIX shared memory (shm_open()
+      name set by the shared_state_name controller parameter).
+
+      The region starts with a shared_state_header, followed by these arrays,
+      each starting at the byte offset recorded in the header (all offsets are
+      multiples of 64):
+
+        joint_names          num_joints        x char[SHARED_STATE_NAME_LENGTH]
+        imu_names            num_imus          x char[SHARED_STATE_NAME_LENGTH]
+        force_torque_names   num_force_torques x char[SHARED_STATE_NAME_LENGTH]
+        joint_position       num_joints        x double
+        joint_velocity       num_joints        x double
+        joint_effort         num_joints        x double
+        imu                  num_imus          x shared_imu_state
+        force_torque         num_force_torques x shared_force_torque_state
+
+      Names are NUL-terminated and never change after the region is created.
+      Everything from utime onwards is guarded by a seqlock: the writer makes
+      sequence odd, updates the values and makes it even again, so a reader
+      that sees the same even sequence before and after copying has a
+      consistent snapshot. All values are host byte order. */
+
+   static const uint32_t SHARED_STATE_MAGIC = 0x53535456;  // "VTSS"
+   static const uint32_t SHARED_STATE_VERSION = 1;
+   static const size_t SHARED_STATE_NAME_LENGTH = 64;
+   static const size_t SHARED_STATE_ALIGNMENT = 64;
+
+   struct shared_state_header
+   {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_joints;
+    uint32_t num_imus;
+    uint32_t num_force_torques;
+    std::atomic<uint32_t> writer_closed;  // set once the writer has gone away
+    uint64_t total_size;
+
+    uint64_t joint_names_offset;
+    uint64_t imu_names_offset;
+    uint64_t force_torque_names_offset;
+    uint64_t joint_position_offset;
+    uint64_t joint_velocity_offset;
+    uint64_t joint_effort_offset;
+    uint64_t imu_offset;
+    uint64_t force_torque_offset;
+
+    alignas(64) std::atomic<uint64_t> sequence;
+    int64_t utime;
+   };
+
+   struct shared_imu_state
+   {
+    double orientation[4];  // quaternion x, y, z, w, as ImuSensorHandle::getOrientation()
+    double angular_velocity[3];
+    double linear_acceleration[3];
+   };
+
+   struct shared_force_torque_state
+   {
+    double force[3];
+    double torque[3];
+   };
+
+   inline uint64_t alignSharedStateOffset(uint64_t offset)
+   {
+    return (offset + SHARED_STATE_ALIGNMENT - 1) & ~static_cast<uint64_t>(SHARED_STATE_ALIGNMENT - 1);
+   }
+
+   // Fill in the offsets and total size of a header for the given counts.
+   inline void computeSharedStateLayout(shared_state_header& header, uint32_t num_joints, uint32_t num_imus,
+                                        uint32_t num_force_torques)
+   {
+    header.num_joints = num_joints;
+    header.num_imus = num_imus;
+    header.num_force_torques = num_force_torques;
+
+    uint64_t offset = alignSharedStateOffset(sizeof(shared_state_header));
+    header.joint_names_offset = offset;
+    offset = alignSharedStateOffset(offset + num_joints * SHARED_STATE_NAME_LENGTH);
+    header.imu_names_offset = offset;
+    offset = alignSharedStateOffset(offset + num_imus * SHARED_STATE_NAME_LENGTH);
+    header.force_torque_names_offset = offset;
+    offset = alignSharedStateOffset(offset + num_force_torques * SHARED_STATE_NAME_LENGTH);
+    header.joint_position_offset = offset;
+    offset = alignSharedStateOffset(offset + num_joints * sizeof(double));
+    header.joint_velocity_offset = offset;
+    offset = alignSharedStateOffset(offset + num_joints * sizeof(double));
+    header.joint_effort_offset = offset;
+    offset = alignSharedStateOffset(offset + num_joints * sizeof(double));
+    header.imu_offset = offset;
+    offset = alignSharedStateOffset(offset + num_imus * sizeof(shared_imu_state));
+    header.force_torque_offset = offset;
+    offset = alignSharedStateOffset(offset + num_force_torques * sizeof(shared_force_torque_state));
+    header.total_size = offset;
+   }
+}
+#endif
@@ -0,0 +1,107 @@
+#include "SharedStateReader.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace valkyrie_translator
+{
+  SharedStateReader::SharedStateReader() : base_(nullptr), size_(0), header_(nullptr)
+  {}
+
+  SharedStateReader::~SharedStateReader()
+  {
+    close();
+  }
+
+  bool SharedStateReader::open(const std::string& name)
+  {
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(shared_state_header))
+    {
+      ::close(fd);
+      return false;
+    }
+    void* memory = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED)
+      return false;
+
+    // magic and version are written last, so only trust the layout once they are valid
+    const shared_state_header* header = static_cast<const shared_state_header*>(memory);
+    bool valid = header->magic == SHARED_STATE_MAGIC && header->version == SHARED_STATE_VERSION;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!valid || header->total_size > static_cast<uint64_t>(st.st_size))
+    {
+      munmap(memory, st.st_size);
+      return false;
+    }
+
+    base_ = static_cast<const char*>(memory);
+    size_ = st.st_size;
+    header_ = header;
+    joint_names_ = readNames(header_->joint_names_offset, header_->num_joints);
+    imu_names_ = readNames(header_->imu_names_offset, header_->num_imus);
+    force_torque_names_ = readNames(header_->force_torque_names_offset, header_->num_force_torques);
+
+    view_.joint_position = reinterpret_cast<const double*>(base_ + header_->joint_position_offset);
+    view_.joint_velocity = reinterpret_cast<const double*>(base_ + header_->joint_velocity_offset);
+    view_.joint_effort = reinterpret_cast<const double*>(base_ + header_->joint_effort_offset);
+    view_.imu = reinterpret_cast<const shared_imu_state*>(base_ + header_->imu_offset);
+    view_.force_torque = reinterpret_cast<const shared_force_torque_state*>(base_ + header_->force_torque_offset);
+    return true;
+  }
+
+  void SharedStateReader::close()
+  {
+    if (!header_)
+      return;
+    munmap(const_cast<char*>(base_), size_);
+    base_ = nullptr;
+    header_ = nullptr;
+    joint_names_.clear();
+    imu_names_.clear();
+    force_torque_names_.clear();
+  }
+
+  bool SharedStateReader::read(shared_state_snapshot& snapshot, int max_attempts) const
+  {
+    const uint32_t num_joints = header_->num_joints;
+    const uint32_t num_imus = header_->num_imus;
+    const uint32_t num_force_torques = header_->num_force_torques;
+    snapshot.joint_position.resize(num_joints);
+    snapshot.joint_velocity.resize(num_joints);
+    snapshot.joint_effort.resize(num_joints);
+    snapshot.imu.resize(num_imus);
+    snapshot.force_torque.resize(num_force_torques);
+
+    return read([&](const shared_state_view& view) {
+      snapshot.sequence = view.sequence;
+      snapshot.utime = view.utime;
+      memcpy(snapshot.joint_position.data(), view.joint_position, num_joints * sizeof(double));
+      memcpy(snapshot.joint_velocity.data(), view.joint_velocity, num_joints * sizeof(double));
+      memcpy(snapshot.joint_effort.data(), view.joint_effort, num_joints * sizeof(double));
+      memcpy(snapshot.imu.data(), view.imu, num_imus * sizeof(shared_imu_state));
+      memcpy(snapshot.force_torque.data(), view.force_torque, num_force_torques * sizeof(shared_force_torque_state));
+    }, max_attempts);
+  }
+
+  std::vector<std::string> SharedStateReader::readNames(uint64_t offset, uint32_t count) const
+  {
+    std::vector<std::string> names(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+      const char* name = base_ + offset + i * SHARED_STATE_NAME_LENGTH;
+      names[i] = std::string(name, strnlen(name, SHARED_STATE_NAME_LENGTH));
+    }
+    return names;
+  }
+}
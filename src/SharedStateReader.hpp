@@ -0,0 +1,104 @@
+#ifndef SHAREDSTATEREADER_HPP
+#define SHAREDSTATEREADER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "SharedStateLayout.hpp"
+
+namespace valkyrie_translator
+{
+
+   // Pointers straight into the shared region; only valid inside SharedStateReader::read().
+   struct shared_state_view
+   {
+    uint64_t sequence;
+    int64_t utime;
+    const double* joint_position;
+    const double* joint_velocity;
+    const double* joint_effort;
+    const shared_imu_state* imu;
+    const shared_force_torque_state* force_torque;
+   };
+
+   // A consistent copy of the exported state.
+   struct shared_state_snapshot
+   {
+    uint64_t sequence;
+    int64_t utime;
+    std::vector<double> joint_position;
+    std::vector<double> joint_velocity;
+    std::vector<double> joint_effort;
+    std::vector<shared_imu_state> imu;
+    std::vector<shared_force_torque_state> force_torque;
+   };
+
+   /* Reads the robot state a JointStatePublisher or LCM2ROSControl exports to
+      shared memory (see SharedStateLayout.hpp) from another process on the
+      same host.
+
+      read(visitor) is zero-copy: it calls visitor(const shared_state_view&)
+      on the live region and returns false if the writer updated it
+      meanwhile, in which case whatever the visitor computed must be thrown
+      away (it is called again, up to max_attempts times). read(snapshot)
+      copies into preallocated vectors instead. Compare sequence() against the
+      last value read to find out whether new state is available. */
+   class SharedStateReader
+   {
+   public:
+        SharedStateReader();
+        ~SharedStateReader();
+
+        // Map the named region; fails if it does not exist or has an unknown layout.
+        bool open(const std::string& name);
+        void close();
+        bool isOpen() const { return header_ != nullptr; }
+
+        // True once the writer has shut down; reopen to pick up its successor.
+        bool writerClosed() const { return header_->writer_closed.load(std::memory_order_acquire) != 0; }
+
+        uint64_t sequence() const { return header_->sequence.load(std::memory_order_acquire); }
+
+        const std::vector<std::string>& jointNames() const { return joint_names_; }
+        const std::vector<std::string>& imuNames() const { return imu_names_; }
+        const std::vector<std::string>& forceTorqueNames() const { return force_torque_names_; }
+
+        template<class Visitor>
+        bool read(Visitor&& visitor, int max_attempts = 100) const
+        {
+          for (int attempt = 0; attempt < max_attempts; attempt++)
+          {
+            uint64_t sequence = header_->sequence.load(std::memory_order_acquire);
+            if (sequence & 1)
+              continue;
+            shared_state_view view = view_;
+            view.sequence = sequence;
+            view.utime = header_->utime;
+            visitor(static_cast<const shared_state_view&>(view));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (header_->sequence.load(std::memory_order_relaxed) == sequence)
+              return true;
+          }
+          return false;
+        }
+
+        bool read(shared_state_snapshot& snapshot, int max_attempts = 100) const;
+
+   private:
+        SharedStateReader(const SharedStateReader&);
+        SharedStateReader& operator=(const SharedStateReader&);
+
+        std::vector<std::string> readNames(uint64_t offset, uint32_t count) const;
+
+        const char* base_;
+        size_t size_;
+        const shared_state_header* header_;
+        shared_state_view view_;  // array pointers, filled in by open()
+        std::vector<std::string> joint_names_;
+        std::vector<std::string> imu_names_;
+        std::vector<std::string> force_torque_names_;
+   };
+}
+#endif
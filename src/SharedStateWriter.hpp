@@ -0,0 +1,178 @@
+#ifndef SHAREDSTATEWRITER_HPP
+#define SHAREDSTATEWRITER_HPP
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <ros/console.h>
+
+#include "SharedStateLayout.hpp"
+
+namespace valkyrie_translator
+{
+
+   /* Writes robot state into a shared memory region for co-located readers
+      (see SharedStateLayout.hpp and SharedStateReader.hpp).
+
+      open() creates the region and fills in the layout and names; it is not
+      realtime safe. Each control tick then brackets its writes with
+      beginWrite()/endWrite(), which only touch memory. The region is unlinked
+      when the writer is destroyed; readers still mapping it see
+      writer_closed.
+
+      A writer holds an exclusive flock() on its region for as long as it is
+      open, so a second writer given the same name fails instead of replacing
+      a region that is still being written. A region left behind by a writer
+      that died is replaced. */
+   class SharedStateWriter
+   {
+   public:
+        SharedStateWriter() : fd_(-1), header_(nullptr) {}
+
+        ~SharedStateWriter()
+        {
+          close();
+        }
+
+        bool open(const std::string& name, const std::vector<std::string>& joint_names,
+                  const std::vector<std::string>& imu_names, const std::vector<std::string>& force_torque_names)
+        {
+          close();
+
+          shared_state_header layout;
+          computeSharedStateLayout(layout, joint_names.size(), imu_names.size(), force_torque_names.size());
+
+          // start from a fresh region so readers of an old one notice it is closed
+          int old_fd = shm_open(name.c_str(), O_RDONLY, 0);
+          if (old_fd >= 0)
+          {
+            bool in_use = flock(old_fd, LOCK_EX | LOCK_NB) != 0;
+            ::close(old_fd);
+            if (in_use)
+            {
+              ROS_ERROR("Shared memory region %s is already being written by another controller, "
+                        "give each one its own shared_state_name", name.c_str());
+              return false;
+            }
+            shm_unlink(name.c_str());
+          }
+          int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+          if (fd < 0)
+          {
+            ROS_ERROR("Could not create shared memory region %s: %s", name.c_str(), strerror(errno));
+            return false;
+          }
+          if (flock(fd, LOCK_EX | LOCK_NB) != 0)
+          {
+            ROS_ERROR("Could not lock shared memory region %s: %s", name.c_str(), strerror(errno));
+            ::close(fd);
+            return false;
+          }
+          if (ftruncate(fd, layout.total_size) != 0)
+          {
+            ROS_ERROR("Could not size shared memory region %s: %s", name.c_str(), strerror(errno));
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+          }
+          void* memory = mmap(nullptr, layout.total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+          if (memory == MAP_FAILED)
+          {
+            ROS_ERROR("Could not map shared memory region %s: %s", name.c_str(), strerror(errno));
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+          }
+          // keep the region resident so the control loop never page faults on it
+          if (mlock(memory, layout.total_size) != 0)
+            ROS_WARN("Could not lock shared memory region %s in RAM, the control loop may page fault on it: %s",
+                     name.c_str(), strerror(errno));
+
+          name_ = name;
+          fd_ = fd;  // kept open for the lock
+          base_ = static_cast<char*>(memory);
+          header_ = new (memory) shared_state_header;
+          computeSharedStateLayout(*header_, joint_names.size(), imu_names.size(), force_torque_names.size());
+          header_->writer_closed.store(0);
+          header_->sequence.store(0);
+          header_->utime = 0;
+          copyNames(header_->joint_names_offset, joint_names);
+          copyNames(header_->imu_names_offset, imu_names);
+          copyNames(header_->force_torque_names_offset, force_torque_names);
+
+          joint_position_ = reinterpret_cast<double*>(base_ + header_->joint_position_offset);
+          joint_velocity_ = reinterpret_cast<double*>(base_ + header_->joint_velocity_offset);
+          joint_effort_ = reinterpret_cast<double*>(base_ + header_->joint_effort_offset);
+          imu_ = reinterpret_cast<shared_imu_state*>(base_ + header_->imu_offset);
+          force_torque_ = reinterpret_cast<shared_force_torque_state*>(base_ + header_->force_torque_offset);
+
+          // publish the layout before any reader can see a valid magic
+          std::atomic_thread_fence(std::memory_order_release);
+          header_->version = SHARED_STATE_VERSION;
+          header_->magic = SHARED_STATE_MAGIC;
+          return true;
+        }
+
+        void close()
+        {
+          if (!header_)
+            return;
+          header_->writer_closed.store(1, std::memory_order_release);
+          munmap(base_, header_->total_size);
+          shm_unlink(name_.c_str());
+          ::close(fd_);
+          fd_ = -1;
+          header_ = nullptr;
+        }
+
+        bool isOpen() const { return header_ != nullptr; }
+
+        void beginWrite(int64_t utime)
+        {
+          header_->sequence.store(header_->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_release);
+          header_->utime = utime;
+        }
+
+        void endWrite()
+        {
+          header_->sequence.store(header_->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        double* jointPosition() { return joint_position_; }
+        double* jointVelocity() { return joint_velocity_; }
+        double* jointEffort() { return joint_effort_; }
+        shared_imu_state* imu() { return imu_; }
+        shared_force_torque_state* forceTorque() { return force_torque_; }
+
+   private:
+        SharedStateWriter(const SharedStateWriter&);
+        SharedStateWriter& operator=(const SharedStateWriter&);
+
+        void copyNames(uint64_t offset, const std::vector<std::string>& names)
+        {
+          for (size_t i = 0; i < names.size(); i++)
+            strncpy(base_ + offset + i * SHARED_STATE_NAME_LENGTH, names[i].c_str(), SHARED_STATE_NAME_LENGTH - 1);
+        }
+
+        std::string name_;
+        int fd_;
+        char* base_;
+        shared_state_header* header_;
+        double* joint_position_;
+        double* joint_velocity_;
+        double* joint_effort_;
+        shared_imu_state* imu_;
+        shared_force_torque_state* force_torque_;
+   };
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace valkyrie_translator
+{
+
+   /* Wait-free single-producer / single-consumer triple buffer.
+
+      The producer fills writeBuffer() and hands it over with publish(); the
+      consumer calls consume() and then reads readBuffer(), which always holds
+      the newest complete value the producer published. Ownership moves by
+      swapping a single atomic byte, so neither side ever blocks or sees a
+      partially written value. Buffers are allocated once (see reset()), which
+      keeps the consumer side safe to run from the realtime thread. */
+   template <typename T>
+   class TripleBuffer
+   {
+   public:
+        TripleBuffer() : write_(0), middle_(1), read_(2) {}
+
+        // Not thread-safe: call before producer and consumer start running.
+        void reset(const T& value)
+        {
+          for (int i = 0; i < 3; i++)
+            buffers_[i] = value;
+          write_ = 0;
+          middle_.store(1, std::memory_order_relaxed);
+          read_ = 2;
+        }
+
+        // Producer side
+        T& writeBuffer() { return buffers_[write_]; }
+
+        void publish()
+        {
+          uint8_t previous = middle_.exchange(write_ | FRESH, std::memory_order_acq_rel);
+          write_ = previous & INDEX_MASK;
+        }
+
+        // Consumer side. Returns true if a newer value was picked up.
+        bool consume()
+        {
+          if (!(middle_.load(std::memory_order_relaxed) & FRESH))
+            return false;
+          uint8_t previous = middle_.exchange(read_, std::memory_order_acq_rel);
+          read_ = previous & INDEX_MASK;
+          return true;
+        }
+
+        const T& readBuffer() const { return buffers_[read_]; }
+
+   private:
+        static const uint8_t INDEX_MASK = 0x3;
+        static const uint8_t FRESH = 0x4;
+
+        T buffers_[3];
+        uint8_t write_;
+        std::atomic<uint8_t> middle_;
+        uint8_t read_;
+   };
+}
+#endif
@@ -0,0 +1,110 @@
+#ifndef WAYPOINTQUEUE_HPP
+#define WAYPOINTQUEUE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace valkyrie_translator
+{
+
+   /* Wait-free single-producer / single-consumer ring of trajectory
+      waypoints, each holding one position per joint slot. All storage is
+      allocated by reset(), so both sides are safe on the realtime thread.
+
+      The producer fills up to space() slots past the end through
+      newPosition(k) / newTime(k) / newFlags(k), k counting from 0 for the
+      first free slot, and makes them visible all at once with commit(). The
+      consumer sees size() entries through position(k) / time(k) / flags(k),
+      k counting from the front, owns them until pop(), and may write the
+      absolute arrivalTime(k) of any entry it sees.
+
+      A trajectory that does not APPEND supersedes everything queued before
+      it, and the consumer pops those entries when it reaches the new
+      STARTS_MOTION. The ring therefore holds twice capacity(): a replacing
+      trajectory of up to capacity() waypoints fits while the one it replaces
+      is still queued, and only appending trajectories share capacity() with
+      what is already queued. */
+   class WaypointQueue
+   {
+   public:
+        // flags(k) bits
+        static const uint8_t STARTS_MOTION = 1;  // first waypoint of a trajectory message
+        static const uint8_t APPEND = 2;         // that trajectory queues after the previous one
+
+        WaypointQueue() : num_joints_(0), capacity_(0), mask_(0), motion_start_(0), head_(0), tail_(0) {}
+
+        // Not thread-safe: call before producer and consumer start running.
+        void reset(size_t capacity, size_t num_joints)
+        {
+          size_t rounded = 1;
+          while (rounded < capacity)
+            rounded <<= 1;
+          num_joints_ = num_joints;
+          capacity_ = rounded;
+          mask_ = 2 * rounded - 1;
+          positions_.assign(2 * rounded * num_joints, 0.0);
+          times_.assign(2 * rounded, 0.0);
+          arrival_times_.assign(2 * rounded, 0.0);
+          flags_.assign(2 * rounded, 0);
+          motion_start_ = 0;
+          head_.store(0, std::memory_order_relaxed);
+          tail_.store(0, std::memory_order_relaxed);
+        }
+
+        size_t capacity() const { return capacity_; }
+        size_t numJoints() const { return num_joints_; }
+
+        // Producer side
+        // Waypoints a trajectory may have, depending on whether it appends. A
+        // replacing one only falls short of capacity() when several arrive
+        // before the consumer has dropped what they supersede.
+        size_t space(bool append) const
+        {
+          const size_t head = head_.load(std::memory_order_relaxed);
+          const size_t tail = tail_.load(std::memory_order_acquire);
+          const size_t free_slots = mask_ + 1 - (head - tail);
+          const size_t queued = append ? head - std::max(tail, motion_start_) : 0;
+          return std::min(capacity_ - queued, free_slots);
+        }
+        double* newPosition(size_t k) { return &positions_[slot(head_.load(std::memory_order_relaxed) + k) * num_joints_]; }
+        double& newTime(size_t k) { return times_[slot(head_.load(std::memory_order_relaxed) + k)]; }
+        uint8_t& newFlags(size_t k) { return flags_[slot(head_.load(std::memory_order_relaxed) + k)]; }
+        void commit(size_t count)
+        {
+          const size_t head = head_.load(std::memory_order_relaxed);
+          const uint8_t first = flags_[slot(head)];
+          if (count > 0 && (first & STARTS_MOTION) && !(first & APPEND))
+            motion_start_ = head;
+          head_.store(head + count, std::memory_order_release);
+        }
+
+        // Consumer side
+        size_t size() const
+        {
+          return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_relaxed);
+        }
+        const double* position(size_t k) const { return &positions_[slot(tail_.load(std::memory_order_relaxed) + k) * num_joints_]; }
+        double time(size_t k) const { return times_[slot(tail_.load(std::memory_order_relaxed) + k)]; }
+        uint8_t flags(size_t k) const { return flags_[slot(tail_.load(std::memory_order_relaxed) + k)]; }
+        double& arrivalTime(size_t k) { return arrival_times_[slot(tail_.load(std::memory_order_relaxed) + k)]; }
+        void pop(size_t count) { tail_.store(tail_.load(std::memory_order_relaxed) + count, std::memory_order_release); }
+
+   private:
+        size_t slot(size_t index) const { return index & mask_; }
+
+        size_t num_joints_;
+        size_t capacity_;
+        size_t mask_;
+        size_t motion_start_;  // producer only: first entry of the newest replacing trajectory
+        std::vector<double> positions_;
+        std::vector<double> times_;
+        std::vector<double> arrival_times_;  // absolute, assigned by the consumer
+        std::vector<uint8_t> flags_;
+        std::atomic<size_t> head_;
+        std::atomic<size_t> tail_;
+   };
+}
+#endif
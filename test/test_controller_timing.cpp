@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "ControllerTiming.hpp"
+
+using namespace valkyrie_translator;
+
+namespace
+{
+  // Upper edge of the bucket holding ns: with one larger sample, the 0th
+  // percentile is that edge rather than being clamped to the maximum.
+  uint64_t bucketEdge(uint64_t ns)
+  {
+    LatencyHistogram histogram;
+    histogram.add(ns);
+    histogram.add(UINT64_MAX);
+    return histogram.percentile(0.0);
+  }
+}
+
+TEST(LatencyHistogram, emptyAndReset)
+{
+  LatencyHistogram histogram;
+  EXPECT_EQ(0u, histogram.count());
+  EXPECT_EQ(0u, histogram.min());
+  EXPECT_EQ(0u, histogram.max());
+  EXPECT_EQ(0u, histogram.percentile(0.5));
+
+  histogram.add(1000);
+  histogram.add(5);
+  EXPECT_EQ(2u, histogram.count());
+  EXPECT_EQ(5u, histogram.min());
+  EXPECT_EQ(1000u, histogram.max());
+
+  histogram.reset();
+  EXPECT_EQ(0u, histogram.count());
+  EXPECT_EQ(0u, histogram.min());
+  EXPECT_EQ(0u, histogram.max());
+  EXPECT_EQ(0u, histogram.percentile(0.99));
+}
+
+TEST(LatencyHistogram, bucketBoundaries)
+{
+  // below four nanoseconds every value has its own bucket
+  for (uint64_t ns = 0; ns < 8; ns++)
+    EXPECT_EQ(ns, bucketEdge(ns));
+  // then four buckets per power of two
+  EXPECT_EQ(9u, bucketEdge(8));
+  EXPECT_EQ(9u, bucketEdge(9));
+  EXPECT_EQ(11u, bucketEdge(10));
+  EXPECT_EQ(15u, bucketEdge(14));
+  EXPECT_EQ(639u, bucketEdge(512));
+  EXPECT_EQ(1023u, bucketEdge(1000));
+  EXPECT_EQ(1023u, bucketEdge(1023));
+  EXPECT_EQ(1279u, bucketEdge(1024));
+
+  // every bucket edge is the last value in its bucket and within 25% of it
+  for (uint64_t ns = 1; ns < (1ULL << 40); ns = ns * 5 / 4 + 1)
+  {
+    uint64_t edge = bucketEdge(ns);
+    EXPECT_GE(edge, ns);
+    EXPECT_LE(edge - ns, ns / 4) << ns;
+    EXPECT_EQ(edge, bucketEdge(edge)) << ns;
+    EXPECT_GT(bucketEdge(edge + 1), edge) << ns;
+  }
+}
+
+TEST(LatencyHistogram, largestValuesLandInTheTopBucket)
+{
+  const uint64_t top = (1ULL << 63) + 3 * (1ULL << 61);
+  EXPECT_EQ(top - 1, bucketEdge(top - 1));
+  EXPECT_EQ(UINT64_MAX, bucketEdge(top));
+
+  LatencyHistogram histogram;
+  histogram.add(UINT64_MAX);
+  histogram.add(UINT64_MAX - 1);
+  EXPECT_EQ(2u, histogram.count());
+  EXPECT_EQ(UINT64_MAX, histogram.percentile(0.0));
+  EXPECT_EQ(UINT64_MAX, histogram.percentile(1.0));
+}
+
+TEST(LatencyHistogram, percentilesBoundTheExactValue)
+{
+  std::mt19937 rng(1);
+  std::lognormal_distribution<double> duration(10.0, 1.5);
+  LatencyHistogram histogram;
+  std::vector<uint64_t> samples;
+  for (int i = 0; i < 10000; i++)
+  {
+    uint64_t ns = static_cast<uint64_t>(duration(rng));
+    histogram.add(ns);
+    samples.push_back(ns);
+  }
+  std::sort(samples.begin(), samples.end());
+
+  EXPECT_EQ(samples.front(), histogram.min());
+  EXPECT_EQ(samples.back(), histogram.max());
+  EXPECT_EQ(samples.back(), histogram.percentile(1.0));
+  const double ps[] = {0.0, 0.1, 0.5, 0.9, 0.99, 0.999};
+  for (double p : ps)
+  {
+    uint64_t exact = samples[static_cast<size_t>(p * (samples.size() - 1))];
+    uint64_t reported = histogram.percentile(p);
+    EXPECT_GE(reported, exact) << "p=" << p;
+    EXPECT_LE(reported - exact, exact / 4) << "p=" << p;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
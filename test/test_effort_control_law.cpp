@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "EffortControlLaw.hpp"
+
+using namespace valkyrie_translator;
+
+namespace
+{
+  const size_t MAX_JOINTS = 40;
+
+  // Random gains and setpoints for n joints, including zero gains.
+  joint_command_arrays randomCommand(std::mt19937& rng, size_t n)
+  {
+    std::uniform_real_distribution<double> value(-10.0, 10.0);
+    std::bernoulli_distribution zero(0.2);
+    joint_command_arrays command;
+    command.assign(n);
+    aligned_vector* fields[] = {&command.position, &command.velocity, &command.effort, &command.k_q_p,
+                                &command.k_q_i, &command.k_qd_p, &command.k_f_p, &command.ff_qd,
+                                &command.ff_qd_d, &command.ff_f_d, &command.ff_const};
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+      for (size_t i = 0; i < n; i++)
+        (*fields[f])[i] = zero(rng) ? 0.0 : value(rng);
+    return command;
+  }
+
+  aligned_vector randomValues(std::mt19937& rng, size_t n, double lower, double upper)
+  {
+    std::uniform_real_distribution<double> value(lower, upper);
+    aligned_vector values(n);
+    for (size_t i = 0; i < n; i++)
+      values[i] = value(rng);
+    return values;
+  }
+}
+
+// Every joint count exercises a different split between the vector body and the scalar tail.
+TEST(EffortControlLaw, computeEffortMatchesScalarLaw)
+{
+  std::mt19937 rng(1);
+  const double dt = 0.002;
+  for (size_t n = 0; n <= MAX_JOINTS; n++)
+  {
+    for (int trial = 0; trial < 20; trial++)
+    {
+      joint_command_arrays command = randomCommand(rng, n);
+      aligned_vector q = randomValues(rng, n, -3.0, 3.0);
+      aligned_vector qd = randomValues(rng, n, -5.0, 5.0);
+      aligned_vector f = randomValues(rng, n, -100.0, 100.0);
+
+      // one extra entry catches writes past n
+      aligned_vector effort(n + 1, -1234.5);
+      computeEffort(command, q.data(), qd.data(), f.data(), dt, effort.data(), n);
+
+      for (size_t i = 0; i < n; i++)
+      {
+        double expected = computeJointEffort(command, i, q[i], qd[i], f[i], dt);
+        EXPECT_NEAR(expected, effort[i], 1e-12 * std::max(1.0, std::fabs(expected))) << "n=" << n << " joint " << i;
+      }
+      EXPECT_EQ(-1234.5, effort[n]) << "n=" << n;
+    }
+  }
+}
+
+TEST(EffortControlLaw, applyEffortLimitsMatchesScalarLimiter)
+{
+  std::mt19937 rng(2);
+  std::bernoulli_distribution make_nan(0.1);
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  effort_safety_parameters params;
+  params.position_err_bound = 0.2;
+  params.max_change = 50.0;
+  params.hard_limit = 300.0;
+
+  for (size_t n = 0; n <= MAX_JOINTS; n++)
+  {
+    for (int trial = 0; trial < 50; trial++)
+    {
+      effort_limit_arrays limits;
+      limits.min_position = randomValues(rng, n, -2.0, -0.5);
+      limits.max_position = randomValues(rng, n, 0.5, 2.0);
+      limits.max_effort = randomValues(rng, n, 10.0, 200.0);
+
+      // positions reach past the ramp-down band, efforts past the hard limit
+      aligned_vector effort_in = randomValues(rng, n, -400.0, 400.0);
+      aligned_vector q = randomValues(rng, n, -2.5, 2.5);
+      aligned_vector f = randomValues(rng, n, -250.0, 250.0);
+      for (size_t i = 0; i < n; i++)
+      {
+        if (make_nan(rng))
+          effort_in[i] = nan;
+        if (make_nan(rng))
+          q[i] = nan;
+        if (make_nan(rng))
+          f[i] = nan;
+      }
+
+      aligned_vector effort_out(n + 1, -1234.5);
+      std::vector<uint8_t> events(n + 1, 0xff);
+      applyEffortLimits(limits, params, effort_in.data(), q.data(), f.data(), effort_out.data(), events.data(), n);
+
+      for (size_t i = 0; i < n; i++)
+      {
+        double expected;
+        uint8_t expected_events = limitJointEffort(effort_in[i], q[i], f[i], limits.min_position[i],
+                                                   limits.max_position[i], limits.max_effort[i], params, &expected);
+        EXPECT_FALSE(std::isnan(effort_out[i])) << "n=" << n << " joint " << i;
+        EXPECT_EQ(expected, effort_out[i]) << "n=" << n << " joint " << i << " effort " << effort_in[i]
+                                           << " q " << q[i] << " f " << f[i];
+        EXPECT_EQ(expected_events, events[i]) << "n=" << n << " joint " << i << " effort " << effort_in[i]
+                                              << " q " << q[i] << " f " << f[i];
+      }
+      EXPECT_EQ(-1234.5, effort_out[n]) << "n=" << n;
+      EXPECT_EQ(0xff, events[n]) << "n=" << n;
+    }
+  }
+}
+
+TEST(EffortControlLaw, nanEffortIsHardCut)
+{
+  effort_limit_arrays limits;
+  limits.min_position.assign(5, -1.0);
+  limits.max_position.assign(5, 1.0);
+  limits.max_effort.assign(5, 100.0);
+  effort_safety_parameters params = {0.2, 50.0, 300.0};
+
+  aligned_vector effort_in(5, std::numeric_limits<double>::quiet_NaN());
+  aligned_vector q(5, 0.0);
+  aligned_vector f(5, 0.0);
+  aligned_vector effort_out(5, 1.0);
+  std::vector<uint8_t> events(5, 0);
+  applyEffortLimits(limits, params, effort_in.data(), q.data(), f.data(), effort_out.data(), events.data(), 5);
+
+  for (size_t i = 0; i < 5; i++)
+  {
+    EXPECT_EQ(0.0, effort_out[i]) << "joint " << i;
+    EXPECT_EQ(EFFORT_HARD_CUT, events[i]) << "joint " << i;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
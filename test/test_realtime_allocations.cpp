@@ -0,0 +1,216 @@
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <ros/ros.h>
+#include <controller_interface/controller_base.h>
+#include <hardware_interface/joint_command_interface.h>
+#include <hardware_interface/robot_hw.h>
+#include <pluginlib/class_loader.h>
+
+#include "lcmtypes/bot_core/joint_angles_t.hpp"
+#include "lcmtypes/bot_core/joint_state_t.hpp"
+#include "lcmtypes/valkyrie_translator/joint_trajectory_t.hpp"
+
+#include "LCMTransportHub.hpp"
+
+using namespace valkyrie_translator;
+
+namespace
+{
+  // Only the thread under test counts; the controller's publisher and logger threads may allocate.
+  thread_local bool counting = false;
+  thread_local size_t allocations = 0;
+
+  template <class F>
+  size_t allocationsDuring(F f)
+  {
+    allocations = 0;
+    counting = true;
+    f();
+    counting = false;
+    return allocations;
+  }
+}
+
+void* operator new(std::size_t size)
+{
+  if (counting)
+    allocations++;
+  void* p = std::malloc(size > 0 ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  if (counting)
+    allocations++;
+  return std::malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+  return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+
+namespace
+{
+  // Position-controlled joints that reach their command within one tick.
+  class FakeRobot : public hardware_interface::RobotHW
+  {
+  public:
+    explicit FakeRobot(const std::vector<std::string>& names)
+      : position_(names.size(), 0.0), velocity_(names.size(), 0.0), effort_(names.size(), 0.0),
+        command_(names.size(), 0.0)
+    {
+      for (size_t i = 0; i < names.size(); i++)
+      {
+        state_interface_.registerHandle(
+            hardware_interface::JointStateHandle(names[i], &position_[i], &velocity_[i], &effort_[i]));
+        position_interface_.registerHandle(
+            hardware_interface::JointHandle(state_interface_.getHandle(names[i]), &command_[i]));
+      }
+      registerInterface(&state_interface_);
+      registerInterface(&position_interface_);
+    }
+
+    void step(double dt)
+    {
+      for (size_t i = 0; i < command_.size(); i++)
+      {
+        velocity_[i] = (command_[i] - position_[i]) / dt;
+        position_[i] = command_[i];
+      }
+    }
+
+    double position(size_t i) const { return position_[i]; }
+
+  private:
+    hardware_interface::JointStateInterface state_interface_;
+    hardware_interface::PositionJointInterface position_interface_;
+    std::vector<double> position_, velocity_, effort_, command_;
+  };
+
+  class FeedbackCounter
+  {
+  public:
+    FeedbackCounter() : received(0) {}
+
+    void handle(const lcm::ReceiveBuffer* rbuf, const std::string& channel, const bot_core::joint_state_t* msg)
+    {
+      received++;
+    }
+
+    int received;
+  };
+}
+
+// update() and the state publishers over a fake PositionJointInterface, with incoming LCM
+// polled from update(). Decoding a message allocates, so each one arrives on an uncounted tick.
+TEST(RealtimeAllocations, jointPositionGoalControllerUpdate)
+{
+  ros::NodeHandle root_nh;
+  ros::NodeHandle controller_nh("~");
+  std::vector<std::string> joints;
+  std::string command_channel, feedback_channel;
+  ASSERT_TRUE(controller_nh.getParam("joints", joints));
+  ASSERT_TRUE(controller_nh.getParam("command_channel", command_channel));
+  ASSERT_TRUE(controller_nh.getParam("command_feedback_channel", feedback_channel));
+
+  std::shared_ptr<LCMTransportHub> hub = LCMTransportHub::acquire();
+  ASSERT_TRUE(hub != nullptr);
+
+  FakeRobot robot(joints);
+  pluginlib::ClassLoader<controller_interface::ControllerBase> loader("controller_interface",
+                                                                      "controller_interface::ControllerBase");
+  boost::shared_ptr<controller_interface::ControllerBase> controller =
+      loader.createInstance("valkyrie_translator/JointPositionGoalController");
+  std::set<std::string> claimed_resources;
+  ASSERT_TRUE(controller->initRequest(&robot, root_nh, controller_nh, claimed_resources));
+  ASSERT_EQ(joints.size(), claimed_resources.size());
+
+  ros::Time time(100.0);
+  const ros::Duration period(0.002);
+  controller->startRequest(time);
+  auto tick = [&]() {
+    time += period;
+    controller->updateRequest(time, period);
+  };
+  auto expectNoAllocations = [&](int ticks, const char* phase) {
+    for (int k = 0; k < ticks; k++)
+    {
+      EXPECT_EQ(0u, allocationsDuring(tick)) << phase << ", tick " << k;
+      robot.step(period.toSec());
+    }
+  };
+
+  // first ticks allocate nothing either, with nothing received yet
+  expectNoAllocations(50, "holding");
+
+  bot_core::joint_angles_t goal;
+  goal.utime = 0;
+  goal.num_joints = joints.size();
+  goal.joint_name = joints;
+  goal.joint_position.assign(joints.size(), 0.5f);
+  hub->lcm()->publish(command_channel, &goal);
+  tick();
+  robot.step(period.toSec());
+  expectNoAllocations(1000, "goal move");
+  EXPECT_NEAR(0.5, robot.position(0), 1e-6);
+
+  joint_trajectory_t trajectory;
+  trajectory.utime = 0;
+  trajectory.append = false;
+  trajectory.num_joints = joints.size();
+  trajectory.joint_name = joints;
+  trajectory.num_points = 3;
+  trajectory.time_from_start = {0.5f, 1.0f, 1.5f};
+  trajectory.joint_position = {std::vector<float>(joints.size(), 0.2f), std::vector<float>(joints.size(), -0.2f),
+                               std::vector<float>(joints.size(), 0.0f)};
+  hub->lcm()->publish(command_channel + "_TRAJECTORY", &trajectory);
+  tick();
+  robot.step(period.toSec());
+  // jointA's 1 rad/s limit stretches the 1.5 s trajectory to about 2.1 s
+  expectNoAllocations(1500, "trajectory");
+  EXPECT_NEAR(0.0, robot.position(0), 1e-6);
+
+  // the publishers really ran: feedback keeps arriving once something listens
+  FeedbackCounter feedback;
+  lcm::Subscription* subscription = hub->subscribe(feedback_channel, &FeedbackCounter::handle, &feedback);
+  for (int k = 0; k < 500 && feedback.received == 0; k++)
+  {
+    tick();
+    robot.step(period.toSec());
+    ros::WallDuration(period.toSec()).sleep();
+  }
+  hub->unsubscribe(subscription);
+  EXPECT_GT(feedback.received, 0);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "test_realtime_allocations");
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,159 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "SharedStateReader.hpp"
+#include "SharedStateWriter.hpp"
+
+using namespace valkyrie_translator;
+
+namespace
+{
+  const size_t NUM_JOINTS = 40;
+
+  std::string regionName(const char* test)
+  {
+    return "/valkyrie_translator_test_" + std::string(test) + "_" + std::to_string(getpid());
+  }
+
+  std::vector<std::string> names(const char* prefix, size_t count)
+  {
+    std::vector<std::string> result;
+    for (size_t i = 0; i < count; i++)
+      result.push_back(prefix + std::to_string(i));
+    return result;
+  }
+
+  // Every exported value of one tick is that tick's utime.
+  void writeTick(SharedStateWriter& writer, int64_t utime)
+  {
+    const double value = static_cast<double>(utime);
+    writer.beginWrite(utime);
+    for (size_t i = 0; i < NUM_JOINTS; i++)
+    {
+      writer.jointPosition()[i] = value;
+      writer.jointVelocity()[i] = value;
+      writer.jointEffort()[i] = value;
+    }
+    for (size_t i = 0; i < 2; i++)
+    {
+      for (int k = 0; k < 4; k++)
+        writer.imu()[i].orientation[k] = value;
+      for (int k = 0; k < 3; k++)
+      {
+        writer.imu()[i].angular_velocity[k] = value;
+        writer.imu()[i].linear_acceleration[k] = value;
+        writer.forceTorque()[i].force[k] = value;
+        writer.forceTorque()[i].torque[k] = value;
+      }
+    }
+    writer.endWrite();
+  }
+}
+
+TEST(SharedState, readerNeverSeesATornSnapshot)
+{
+  const std::string name = regionName("torn");
+  SharedStateWriter writer;
+  ASSERT_TRUE(writer.open(name, names("joint", NUM_JOINTS), names("imu", 2), names("ft", 2)));
+  writeTick(writer, 0);
+
+  SharedStateReader reader;
+  ASSERT_TRUE(reader.open(name));
+  ASSERT_EQ(NUM_JOINTS, reader.jointNames().size());
+  EXPECT_EQ("joint7", reader.jointNames()[7]);
+
+  std::atomic<bool> done(false);
+  std::thread writing([&]() {
+    for (int64_t utime = 1; !done.load(); utime++)
+      writeTick(writer, utime);
+  });
+
+  shared_state_snapshot snapshot;
+  int consistent = 0;
+  int64_t last_utime = -1, distinct = 0;
+  const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (distinct < 1000 && std::chrono::steady_clock::now() < deadline)
+  {
+    if (!reader.read(snapshot, 1))
+      continue;
+    consistent++;
+    const double value = static_cast<double>(snapshot.utime);
+    EXPECT_EQ(0u, snapshot.sequence % 2);
+    EXPECT_GE(snapshot.utime, last_utime);
+    if (snapshot.utime != last_utime)
+      distinct++;
+    last_utime = snapshot.utime;
+
+    bool torn = false;
+    for (size_t i = 0; i < NUM_JOINTS; i++)
+      torn |= snapshot.joint_position[i] != value || snapshot.joint_velocity[i] != value ||
+              snapshot.joint_effort[i] != value;
+    for (size_t i = 0; i < 2; i++)
+    {
+      for (int k = 0; k < 4; k++)
+        torn |= snapshot.imu[i].orientation[k] != value;
+      for (int k = 0; k < 3; k++)
+        torn |= snapshot.imu[i].angular_velocity[k] != value || snapshot.imu[i].linear_acceleration[k] != value ||
+                snapshot.force_torque[i].force[k] != value || snapshot.force_torque[i].torque[k] != value;
+    }
+    ASSERT_FALSE(torn) << "snapshot of tick " << snapshot.utime;
+  }
+  done = true;
+  writing.join();
+
+  // the reads really overlapped the writes
+  EXPECT_GT(consistent, 0);
+  EXPECT_GT(distinct, 1);
+
+  EXPECT_FALSE(reader.writerClosed());
+  writer.close();
+  EXPECT_TRUE(reader.writerClosed());
+}
+
+TEST(SharedState, secondWriterForALiveRegionFails)
+{
+  const std::string name = regionName("shared");
+  SharedStateWriter first, second;
+  ASSERT_TRUE(first.open(name, names("joint", 3), names("imu", 0), names("ft", 0)));
+  SharedStateReader reader;
+  ASSERT_TRUE(reader.open(name));
+
+  EXPECT_FALSE(second.open(name, names("other", 3), names("imu", 0), names("ft", 0)));
+  EXPECT_FALSE(reader.writerClosed());
+
+  // once the first writer is gone the name is free again
+  first.close();
+  EXPECT_TRUE(second.open(name, names("other", 3), names("imu", 0), names("ft", 0)));
+  SharedStateReader successor;
+  ASSERT_TRUE(successor.open(name));
+  EXPECT_EQ("other0", successor.jointNames()[0]);
+}
+
+TEST(SharedState, regionLeftByADeadWriterIsReplaced)
+{
+  const std::string name = regionName("stale");
+  int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(0, ftruncate(fd, 4096));
+  close(fd);
+
+  SharedStateWriter writer;
+  EXPECT_TRUE(writer.open(name, names("joint", 3), names("imu", 0), names("ft", 0)));
+  SharedStateReader reader;
+  EXPECT_TRUE(reader.open(name));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}